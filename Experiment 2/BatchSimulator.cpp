@@ -0,0 +1,568 @@
+/*
+    Batched execution of one program over many initial states.
+
+    The lanes share the program and therefore the control of the pipeline: which instruction is in which stage,
+    stalls, the pc and the statistics. Only the register and memory values differ, so a group of lanes with the
+    same control keeps one copy of the control state and one row of values per pipeline register, and each stage
+    becomes a vector operation over the lanes (AVX2 when compiled with -mavx2, a plain loop otherwise).
+    A beqz that is taken in some lanes of a group and not in others splits the group in two at the end of the cycle.
+    The stages mirror Single_step_execution of Simulator.cpp step by step, including its forwarding behaviour.
+*/
+
+#include "BatchSimulator.h"
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace mips
+{
+
+const int Words = Simulator::MemoryWords; // Words of data memory per lane
+const int Vector = 8;   // Lanes per vector register
+
+// Define a group of lanes following the same control path.
+struct LaneGroup
+{
+    int lo = 0;       // First lane of the span covered by the group
+    int n = 0;        // Number of lanes in the span
+    int active = 0;   // Number of lanes of the span in the group
+    vector<int> mask; // -1 for lanes of the group, 0 for other lanes in the span
+
+    // Control, shared by all lanes of the group
+    vector<char> pipline; // Stage of each instruction in the pipline, oldest first
+    int pc = 0;
+    int Instruction_num = 1;
+    int ClockCycles = 0;
+    int StallCycles = 0;
+    bool has_end = false;
+    bool stall = false;
+    bool writing[32] = {false};
+    bool has_else[32] = {false}; // Whether RegisterFile_else holds a value of the register
+    int if_ir = -1;              // Instruction in each pipeline register, as index into the program
+    int id_ir = -1;
+    int ex_ir = -1;
+    int wb_ir = -1;
+    int id_imm = 0;
+    int branch = -1;             // pc of the lanes taking a divergent beqz this cycle
+    long left = 0;               // Clockcycles left in the current step
+    long ran = 0;                // Clockcycles executed in the current step
+
+    // Pipeline registers, one value per lane of the span
+    vector<int> id_a, id_b, ex_o, ex_b, wb_lmd, wb_o;
+    vector<int> taken;            // Lanes taking the beqz this cycle
+    vector<int> else_value[32];   // First forwarded value of each register, the only one readRegister finds
+
+    vector<vector<int> *> rows()
+    {
+        vector<vector<int> *> r = {&mask, &id_a, &id_b, &ex_o, &ex_b, &wb_lmd, &wb_o, &taken};
+        for (int i = 0; i < 32; i++)
+            if (has_else[i])
+                r.push_back(&else_value[i]);
+        return r;
+    }
+};
+
+namespace
+{
+
+// o = a + b for n lanes
+void Lane_add(int *o, const int *a, const int *b, int n)
+{
+    int j = 0;
+#ifdef __AVX2__
+    for (; j + Vector <= n; j += Vector)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + j));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + j));
+        _mm256_storeu_si256((__m256i *)(o + j), _mm256_add_epi32(x, y));
+    }
+#endif
+    for (; j < n; j++)
+        o[j] = a[j] + b[j];
+}
+
+// o = a + imm for n lanes, the address generation of lw/sw
+void Lane_add_imm(int *o, const int *a, int imm, int n)
+{
+    int j = 0;
+#ifdef __AVX2__
+    __m256i y = _mm256_set1_epi32(imm);
+    for (; j + Vector <= n; j += Vector)
+        _mm256_storeu_si256((__m256i *)(o + j), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(a + j)), y));
+#endif
+    for (; j < n; j++)
+        o[j] = a[j] + imm;
+}
+
+// o = v in the lanes of mask, the register writeback
+void Lane_blend(int *o, const int *v, const int *mask, int n)
+{
+    int j = 0;
+#ifdef __AVX2__
+    for (; j + Vector <= n; j += Vector)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(o + j));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(v + j));
+        __m256i m = _mm256_loadu_si256((const __m256i *)(mask + j));
+        _mm256_storeu_si256((__m256i *)(o + j), _mm256_blendv_epi8(x, y, m));
+    }
+#endif
+    for (; j < n; j++)
+        if (mask[j])
+            o[j] = v[j];
+}
+
+// o = word addr of the data memory of each lane of mask, 0 for other lanes and addresses outside the data memory.
+// memory points to word 0 of the first lane; word a of lane j is at memory[a * width + j].
+void Lane_gather(int *o, const int *memory, int width, const int *addr, const int *mask, int n)
+{
+    int j = 0;
+#ifdef __AVX2__
+    __m256i w = _mm256_set1_epi32(width);
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i low = _mm256_set1_epi32(-1);
+    __m256i high = _mm256_set1_epi32(Words);
+    for (; j + Vector <= n; j += Vector)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(addr + j));
+        __m256i m = _mm256_loadu_si256((const __m256i *)(mask + j));
+        m = _mm256_and_si256(m, _mm256_and_si256(_mm256_cmpgt_epi32(a, low), _mm256_cmpgt_epi32(high, a)));
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(a, w), lane);
+        _mm256_storeu_si256((__m256i *)(o + j), _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), memory + j, index, m, 4));
+    }
+#endif
+    for (; j < n; j++)
+        o[j] = mask[j] && addr[j] >= 0 && addr[j] < Words ? memory[addr[j] * width + j] : 0;
+}
+
+// Store v to word addr of the data memory of each lane of mask. AVX2 has no scatter, so this stays a loop.
+void Lane_scatter(int *memory, int width, const int *addr, const int *v, const int *mask, int n)
+{
+    for (int j = 0; j < n; j++)
+        if (mask[j] && addr[j] >= 0 && addr[j] < Words)
+            memory[addr[j] * width + j] = v[j];
+}
+
+// Register number of a register name
+int Register_number(const string &name)
+{
+    return stoi(name.substr(1));
+}
+
+} // namespace
+
+BatchSimulator::BatchSimulator(int lanes, bool forwarding) : K(lanes), Forwarding(forwarding)
+{
+    if (lanes < 1 || lanes > MaxLanes)
+        throw out_of_range("BatchSimulator: " + to_string(lanes) + " lanes, expected 1 to " + to_string(MaxLanes));
+    Width = (K + Vector - 1) / Vector * Vector;
+    Registers.assign(32 * Width, 0);
+    Memory.assign(Words * Width, 0);
+    Lane_group.assign(K, 0);
+    reset();
+}
+
+BatchSimulator::~BatchSimulator()
+{
+    for (LaneGroup *G : Groups)
+        delete G;
+}
+
+void BatchSimulator::load(const vector<Instruction> &program)
+{
+    Program.clear();
+    for (const Instruction &ir : program)
+        Program.push_back({ir.type, Register_number(ir.rs), Register_number(ir.rt), Register_number(ir.rd), ir.imm});
+    reset();
+}
+
+void BatchSimulator::load(const vector<uint32_t> &words)
+{
+    vector<Instruction> program;
+    for (uint32_t word : words)
+        program.push_back(Instruction_decode(word));
+    load(program);
+}
+
+bool BatchSimulator::load(const string &path)
+{
+    Simulator sim;
+    if (!sim.load(path))
+        return false;
+    load(sim);
+    return true;
+}
+
+void BatchSimulator::load(const Simulator &sim)
+{
+    vector<Instruction> program;
+    for (int i = 0; i < sim.program_size(); i++)
+        program.push_back(sim.instruction(4 * i));
+    load(program);
+    vector<int> memory = sim.initial_memory();
+    for (int a = 0; a < Words; a++)
+        fill_n(&Memory[a * Width], K, memory[a]);
+}
+
+void BatchSimulator::reset()
+{
+    for (LaneGroup *G : Groups)
+        delete G;
+    Groups.assign(1, new LaneGroup);
+    LaneGroup &G = *Groups[0];
+    G.n = G.active = K;
+    G.mask.assign(K, -1);
+    for (vector<int> *r : G.rows())
+        r->resize(K, 0);
+    fill(Lane_group.begin(), Lane_group.end(), 0);
+    fill(Registers.begin(), Registers.end(), 0);
+    fill(Memory.begin(), Memory.end(), 0);
+    fill_n(&Registers[1 * Width], K, 1);
+    fill_n(&Registers[2 * Width], K, 2);
+}
+
+bool BatchSimulator::finished() const
+{
+    for (LaneGroup *G : Groups)
+        if (!G->has_end)
+            return false;
+    return true;
+}
+
+// Throw if lane is not a lane or index is outside [0, size) (registers or data memory)
+void BatchSimulator::check(const char *member, int lane, int index, int size) const
+{
+    if (lane < 0 || lane >= K)
+        throw out_of_range(string("BatchSimulator::") + member + ": no lane " + to_string(lane));
+    if (index < 0 || index >= size)
+        throw out_of_range(string("BatchSimulator::") + member + ": index " + to_string(index) + " out of range");
+}
+
+void BatchSimulator::set_register(int lane, int reg, int value)
+{
+    check("set_register", lane, reg, 32);
+    Registers[reg * Width + lane] = value;
+}
+
+void BatchSimulator::set_memory(int lane, int addr, int value)
+{
+    check("set_memory", lane, addr, Words);
+    Memory[addr * Width + lane] = value;
+}
+
+int BatchSimulator::reg(int lane, int reg) const
+{
+    check("reg", lane, reg, 32);
+    return Registers[reg * Width + lane];
+}
+
+int BatchSimulator::memory(int lane, int addr) const
+{
+    check("memory", lane, addr, Words);
+    return Memory[addr * Width + lane];
+}
+
+Statistics BatchSimulator::stats(int lane) const
+{
+    check("stats", lane, 0, 1);
+    const LaneGroup &G = *Groups[Lane_group[lane]];
+    return {G.ClockCycles, G.StallCycles, G.Instruction_num - 1};
+}
+
+long BatchSimulator::step(long n)
+{
+    if (Program.empty())
+        return 0;
+    for (LaneGroup *G : Groups)
+    {
+        G->left = n;
+        G->ran = 0;
+    }
+    // Groups are independent, so each runs its clockcycles in one go. A group split off runs the rest of the step.
+    long most = 0;
+    for (int g = 0; g < (int)Groups.size(); g++)
+    {
+        while (Groups[g]->left > 0 && !Groups[g]->has_end)
+        {
+            LaneGroup &G = *Groups[g];
+            cycle(G);
+            G.left--;
+            G.ran++;
+            if (G.branch >= 0)
+                split(g);
+        }
+        most = max(most, Groups[g]->ran);
+    }
+    return most;
+}
+
+long BatchSimulator::run()
+{
+    return step(LONG_MAX);
+}
+
+// Move the lanes taking a divergent beqz into a new group
+void BatchSimulator::split(int g)
+{
+    LaneGroup &G = *Groups[g];
+    LaneGroup *T = new LaneGroup(G);
+    T->pc = G.branch;
+    T->branch = G.branch = -1;
+    T->active = 0;
+    for (int j = 0; j < G.n; j++)
+    {
+        T->mask[j] = G.taken[j];
+        G.mask[j] &= ~G.taken[j];
+        T->active += T->mask[j] != 0;
+    }
+    G.active -= T->active;
+    Groups.push_back(T);
+
+    // Narrow the spans to the lanes of each group
+    for (LaneGroup *H : {&G, T})
+    {
+        int first = 0, last = H->n - 1;
+        while (!H->mask[first])
+            first++;
+        while (!H->mask[last])
+            last--;
+        for (vector<int> *r : H->rows())
+            *r = vector<int>(r->begin() + first, r->begin() + last + 1);
+        H->lo += first;
+        H->n = last - first + 1;
+    }
+    for (int j = 0; j < T->n; j++)
+        if (T->mask[j])
+            Lane_group[T->lo + j] = Groups.size() - 1;
+}
+
+// Register reg of the lanes of a group
+int *BatchSimulator::row(const LaneGroup &G, int reg)
+{
+    return &Registers[reg * Width + G.lo];
+}
+
+// Instructions flowing out to the pipline
+void BatchSimulator::outflow(LaneGroup &G)
+{
+    G.Instruction_num++;
+    G.pipline.push_back(If);
+}
+
+// Execute one clockcycle of a group, as Single_step_execution does for one core
+void BatchSimulator::cycle(LaneGroup &G)
+{
+    int count = Program.size();
+    bool has_add = false;
+    bool true_stall = false;
+    if (G.pipline.empty() && G.pc / 4 < count)
+    {
+        outflow(G);
+        has_add = true;
+    }
+    G.ClockCycles++;
+    for (size_t i = 0; i < G.pipline.size();)
+    {
+        switch (G.pipline[i])
+        {
+        case If:
+            IF(G);
+            G.pipline[i++]++;
+            continue;
+        case Id:
+            if (!G.stall)
+            {
+                ID(G);
+                G.pipline[i]++;
+            }
+            else
+                true_stall = true;
+            i++;
+            break;
+        case Ex:
+            EX(G);
+            G.pipline[i++]++;
+            break;
+        case Mem:
+            MEM(G);
+            G.pipline[i++]++;
+            break;
+        case Wb:
+            WB(G);
+            G.pipline.erase(G.pipline.begin() + i);
+            break;
+        }
+        if (!has_add && !G.stall && G.pc / 4 < count)
+        {
+            outflow(G);
+            has_add = true;
+        }
+    }
+    if (true_stall)
+        G.StallCycles++;
+    if (G.pipline.empty())
+        G.has_end = true;
+}
+
+// Operations of the IF stage.
+void BatchSimulator::IF(LaneGroup &G)
+{
+    if (G.stall)
+        return;
+    G.if_ir = G.pc / 4;
+    const Op &ir = Program[G.if_ir];
+    int taken = 0;
+    if (ir.type == Beqz)
+    {
+        const int *r = row(G, ir.rs);
+        for (int j = 0; j < G.n; j++)
+        {
+            G.taken[j] = G.mask[j] & -(r[j] == 0);
+            taken += G.taken[j] != 0;
+        }
+    }
+    if (taken == G.active)
+        G.pc += ir.imm;
+    else
+    {
+        if (taken)
+            G.branch = G.pc + ir.imm;
+        G.pc += 4;
+    }
+    switch (ir.type)
+    {
+    case Load:
+        G.stall = G.stall || G.writing[ir.rs];
+        break;
+    case Store:
+        G.stall = G.stall || G.writing[ir.rt];
+        break;
+    case Add:
+        G.stall = G.stall || G.writing[ir.rs] || G.writing[ir.rt];
+        break;
+    }
+}
+
+// Operations of the ID stage.
+void BatchSimulator::ID(LaneGroup &G)
+{
+    const Op &ir = Program[G.if_ir];
+    int n = G.n;
+    // Value of a register as the forwarding path reads it
+    auto forwarded = [&](int r, bool from_else, int *o)
+    {
+        if (!from_else)
+            copy_n(row(G, r), n, o);
+        else if (G.has_else[r])
+            copy_n(G.else_value[r].data(), n, o);
+        else
+            fill_n(o, n, -1);
+    };
+    if (!Forwarding)
+    {
+        copy_n(row(G, ir.rs), n, G.id_a.data());
+        copy_n(row(G, ir.rt), n, G.id_b.data());
+        G.id_ir = G.if_ir;
+        G.id_imm = ir.imm;
+    }
+    else if (ir.type != Nop)
+    {
+        // Loads, stores and beqz only check r31 for a forwarded base, as the register scan of Simulator.cpp does
+        G.id_ir = G.if_ir;
+        G.id_imm = ir.imm;
+        if (ir.type == Add)
+        {
+            forwarded(ir.rs, G.writing[ir.rs], G.id_a.data());
+            forwarded(ir.rt, G.writing[ir.rt], G.id_b.data());
+        }
+        else
+        {
+            forwarded(ir.rs, ir.rs == 31 && G.writing[31], G.id_a.data());
+            if (ir.type == Store)
+                forwarded(ir.rt, ir.rt == 31 && G.writing[31], G.id_b.data());
+            else
+                copy_n(row(G, ir.rt), n, G.id_b.data());
+        }
+    }
+    if (ir.type == Load)
+        G.writing[ir.rt] = true;
+    if (ir.type == Add)
+        G.writing[ir.rd] = true;
+}
+
+// Operations of the EX stage.
+void BatchSimulator::EX(LaneGroup &G)
+{
+    G.ex_ir = G.id_ir;
+    if (G.ex_ir < 0)
+        return;
+    const Op &ir = Program[G.ex_ir];
+    if (ir.type == Add)
+    {
+        Lane_add(G.ex_o.data(), G.id_a.data(), G.id_b.data(), G.n);
+        if (Forwarding)
+        {
+            if (!G.has_else[ir.rd])
+                G.else_value[ir.rd] = G.ex_o;
+            G.has_else[ir.rd] = true;
+            G.stall = false;
+        }
+    }
+    else if (ir.type == Load || ir.type == Store)
+    {
+        Lane_add_imm(G.ex_o.data(), G.id_a.data(), G.id_imm, G.n);
+        G.ex_b = G.id_b;
+    }
+}
+
+// Operations of the MEM stage.
+void BatchSimulator::MEM(LaneGroup &G)
+{
+    G.wb_ir = G.ex_ir;
+    if (G.wb_ir < 0)
+        return;
+    const Op &ir = Program[G.wb_ir];
+    if (ir.type == Add)
+        G.wb_o = G.ex_o;
+    else if (ir.type == Load)
+    {
+        Lane_gather(G.wb_lmd.data(), &Memory[G.lo], Width, G.ex_o.data(), G.mask.data(), G.n);
+        if (Forwarding)
+        {
+            if (!G.has_else[ir.rt])
+                G.else_value[ir.rt] = G.wb_lmd;
+            G.has_else[ir.rt] = true;
+            G.stall = false;
+        }
+    }
+    else if (ir.type == Store)
+        Lane_scatter(&Memory[G.lo], Width, G.ex_o.data(), G.ex_b.data(), G.mask.data(), G.n);
+}
+
+// Operations of the WB stage.
+void BatchSimulator::WB(LaneGroup &G)
+{
+    if (G.wb_ir >= 0)
+    {
+        const Op &ir = Program[G.wb_ir];
+        if (ir.type == Add)
+        {
+            Lane_blend(row(G, ir.rd), G.wb_o.data(), G.mask.data(), G.n);
+            G.writing[ir.rd] = false;
+        }
+        else if (ir.type == Load)
+        {
+            Lane_blend(row(G, ir.rt), G.wb_lmd.data(), G.mask.data(), G.n);
+            G.writing[ir.rt] = false;
+        }
+    }
+    if (!Forwarding)
+        G.stall = false;
+}
+
+} // namespace mips
@@ -0,0 +1,95 @@
+/*
+    Batched execution of one program over many initial states.
+    The lanes run in lockstep on registers and data memory stored lane by lane (structure of arrays),
+    so every pipeline stage handles all lanes with a few vector operations. See BatchSimulator.cpp.
+*/
+
+#ifndef BATCH_SIMULATOR_H
+#define BATCH_SIMULATOR_H
+
+#include "Simulator.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace mips
+{
+
+struct LaneGroup;
+
+// K instances (lanes) of the pipeline running the same program, each with its own registers and Simulator::MemoryWords
+// words of data memory.
+// Every lane ends with the registers, data memory and statistics a Simulator gives for the same initial state,
+// except that lw/sw outside the data memory read 0 and are dropped.
+// Each lane takes about 4 KB, mostly its data memory; 1 to MaxLanes lanes (about 1 GB).
+// The constructor and the members that take a lane, register or address check them and throw std::out_of_range.
+class BatchSimulator
+{
+public:
+    static const int MaxLanes = 1 << 18;
+
+    BatchSimulator(int lanes, bool forwarding = false);
+    ~BatchSimulator();
+    BatchSimulator(const BatchSimulator &) = delete;
+    BatchSimulator &operator=(const BatchSimulator &) = delete;
+
+    // Load a program and reset every lane. A file is read as by Simulator::load, including the data section of an image.
+    void load(const std::vector<Instruction> &program);
+    void load(const std::vector<uint32_t> &words);
+    bool load(const std::string &path);
+    // Load the program of a simulator, with its data memory as a reset leaves it.
+    void load(const Simulator &sim);
+
+    // Reset every lane to r1 = 1, r2 = 2, 0 in the other registers and zeroed data memory, keeping the program.
+    void reset();
+    void set_register(int lane, int reg, int value);
+    void set_memory(int lane, int addr, int value);
+
+    // Execute up to n clockcycles of every lane, stopping when all lanes have ended.
+    // Returns the number of clockcycles executed by the slowest lane.
+    long step(long n = 1);
+    long run();
+
+    int lanes() const { return K; }
+    // Number of control paths the lanes have split into at beqz instructions
+    int groups() const { return Groups.size(); }
+    bool finished() const;
+    int reg(int lane, int reg) const;
+    int memory(int lane, int addr) const;
+    Statistics stats(int lane) const;
+
+private:
+    // Define instructions with register numbers instead of names.
+    struct Op
+    {
+        int type = 0;
+        int rs = 0;
+        int rt = 0;
+        int rd = 0;
+        int imm = 0;
+    };
+
+    void cycle(LaneGroup &G);
+    void outflow(LaneGroup &G);
+    void IF(LaneGroup &G);
+    void ID(LaneGroup &G);
+    void EX(LaneGroup &G);
+    void MEM(LaneGroup &G);
+    void WB(LaneGroup &G);
+    void split(int g);
+    int *row(const LaneGroup &G, int reg);
+    void check(const char *member, int lane, int index, int size) const;
+
+    int K;                        // Number of lanes
+    int Width;                    // Number of lanes rounded up to the vector width
+    bool Forwarding;
+    std::vector<Op> Program;      // Instruction memory
+    std::vector<int> Registers;   // Register r of lane l at r * Width + l
+    std::vector<int> Memory;      // Data memory word a of lane l at a * Width + l
+    std::vector<LaneGroup *> Groups; // Lanes following the same control path
+    std::vector<int> Lane_group;  // Group of each lane
+};
+
+} // namespace mips
+
+#endif
@@ -3,8 +3,19 @@
     The simulator currently only supports five instructions: Load,Store,Add,Beqz,Nop
     To prevent Chinese display errors caused by coding issues, all annotations are in English.
     Use fr command to read file. Please input the absolute path. The file should have one binary instruction (32-bit) per line.
+    Use mc command to run one program per core on shared data memory.
+    Use es/et commands, or the -s/-t flags, to export statistics as JSON/CSV and the cycle diagram as a Chrome trace.
+    Use gs/gp/fz commands to generate random programs and check the pipeline against a functional reference executor.
+    Use bs command to run the loaded program once per value of a register, all values at once in SIMD lanes.
+    fr also accepts a packed binary image: the magic "MIPS", the number of text words and the number of data words (uint32 each),
+    followed by the text words and then the data words (little-endian). The image is memory-mapped and decoded on first fetch.
+    In both formats a word that is not one of the five instructions executes as nop.
+    The simulator core is the library in Simulator.h/Simulator.cpp and BatchSimulator.h/BatchSimulator.cpp.
+    Build the library (libsimulator.a) and this client with make (make AVX2=1 vectorizes the batch lanes with AVX2).
 */
 
+#include "Simulator.h"
+#include "BatchSimulator.h"
 #include <iostream>
 #include <string>
 #include <cstring>
@@ -12,729 +23,762 @@
 #include <list>
 #include <iomanip>
 #include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <new>
 
 using namespace std;
+using namespace mips;
 
-// Define instruction types.
-enum InstructionType
+// Define the parameters of the random program generator.
+struct GeneratorConfig
 {
-    Load = 1,
-    Store,
-    Add,
-    Beqz,
-    Nop
-};
+    int length = 32;   // Number of instructions
+    int distance = 2;  // Distance from an instruction to the producer of its source registers
+    int branch = 10;   // Percentage of beqz instructions
+    int footprint = 16; // Number of data memory words accessed by lw/sw
+} Generator;
 
-// Define pipline stages.
-enum PiplineStage
+// Define a buffered output file for exports.
+struct ExportFile
 {
-    If = 0,
-    Id,
-    Ex,
-    Mem,
-    Wb
-};
+    ofstream out;
+    string buf;
 
-// Define instructions in instruction memory.
-struct Instruction
-{
-    InstructionType type;
-    string rs = "r0";
-    string rt = "r0";
-    string rd = "r0";
-    int imm = -1;
-};
+    ExportFile(string path) : out(path, ios::out | ios::binary) { buf.reserve(1 << 20); }
+    ~ExportFile() { flush(); }
 
-// Define instructions in pipline.
-struct Instructions_in_pipeline
-{
-    Instruction ir;
-    int pc = 0;
-    int stage = 0;
-    int order = 0;
-};
-
-// Define registers.
-struct Register
-{
-    string name;
-    int value;
-    bool writing = false;
-};
+    void flush()
+    {
+        out.write(buf.data(), buf.size());
+        buf.clear();
+    }
 
-// Define the IF_ID pipeline register.
-struct IF_ID
-{
-    int npc = 0;
-    Instruction ir;
-} if_id;
+    // Write out the rest of the export. Returns false if any write failed.
+    bool finish()
+    {
+        flush();
+        out.flush();
+        if (out.good())
+            return true;
+        cout << "Failed to write the file." << endl;
+        return false;
+    }
 
-// Define the ID_EX pipeline register.
-struct ID_EX
-{
-    int alu_a = 0;
-    int alu_b = 0;
-    int imm = 0;
-    Instruction ir;
-} id_ex;
-
-// Define the EX_MEM pipeline register.
-struct EX_MEM
-{
-    int alu_o = 0;
-    int alu_b = 0;
-    Instruction ir;
-} ex_mem;
+    ExportFile &operator<<(const string &text)
+    {
+        buf += text;
+        if (buf.size() >= (1 << 20))
+            flush();
+        return *this;
+    }
 
-// Define the MEM_WB pipeline register.
-struct MEM_WB
-{
-    int lmd = 0;
-    int alu_o = 0;
-    Instruction ir;
-} mem_wb;
+    ExportFile &operator<<(int value) { return *this << to_string(value); }
+};
 
 string stagename[5] = {"IF", "ID", "EX", "MEM", "WB"};
-string ClockCycles_Diagram[1000][1000];     // Clockcycles diagram
-vector<Register> RegisterFile(32, {"", 0}); // Register file
-vector<Instruction> InstructionMemory;      // Instruction memory
-vector<Register> RegisterFile_else;         // Used for data staging in forwarding
-list<Instructions_in_pipeline> pipline;     // The pipline
-int DataMemory[1000] = {0};                 // Data memory
+const char *cellname[7] = {"IF", "ID", "EX", "MEM", "WB", "Stall", ""};
+Simulator sim(false, true); // The simulator driven by the commands
+int Diagram_shown = 0;      // Last clockcycle shown by sd
+const long Max_clockcycles = 1000000; // Runs that do not stop are abandoned after this many clockcycles (bs, batch mode)
 string file_path;
 
-int pc = 0;
-int Instruction_num = 1; // Number of instructions that have already flowed out
-int ClockCycles = 0;     // Number of clockcycles that have already occurred
-int StallCycles = 0;     // Number of clockcycles paused on the pipline
-bool has_end = false;    // Whether the program has ended
-bool stall = false;      // Whether the pipline is paused now
-bool Forwarding = false; // Whether to enable forwarding
+// Instruction fr
+// Read the file
+void File_read()
+{
+    getline(cin, file_path);
+    file_path.erase(0, 1);
+    Diagram_shown = 0;
+    if (!sim.load(file_path))
+        cout << "Failed to read the file." << endl;
+    else if (sim.skipped_lines() != 0)
+        cout << sim.skipped_lines() << " lines of the file are not instructions and were skipped." << endl;
+}
 
-// Convert binary to decimal
-int to_decimalism(string a)
+// Instruction n
+// Single step execution
+void Single_step_execution()
 {
-    int n = stoi(a);
-    int decimalNumber = 0, base = 1;
-    while (n)
+    if (!sim.loaded())
+    {
+        cout << "Please load the program." << endl;
+        return;
+    }
+    if (sim.finished())
     {
-        decimalNumber += (n % 10) * base;
-        n /= 10;
-        base *= 2;
+        cout << "This program has completed execution." << endl;
+        return;
     }
-    return decimalNumber;
+    sim.step();
 }
 
-// Binary instruction processing
-void Instruction_read(string Binary_instruction)
+// Instruction b
+// Sets and executes to a breakpoint
+void Execute_to_breakpoint()
 {
-    if (Binary_instruction.substr(0, 6) == "100000")
+    if (!sim.loaded())
     {
-        Instruction lw{Load, "r" + to_string(to_decimalism(Binary_instruction.substr(6, 5))), "r" + to_string(to_decimalism(Binary_instruction.substr(11, 5))), "r0", to_decimalism(Binary_instruction.substr(16, 16))};
-        InstructionMemory.push_back(lw);
+        cout << "Please load the program." << endl;
+        return;
     }
-    if (Binary_instruction.substr(0, 6) == "101000")
+    int breakpoint;
+    int stage;
+    cin >> breakpoint >> stage;
+    if (breakpoint % 4 != 0 || breakpoint < 0 || breakpoint / 4 >= sim.program_size())
     {
-        Instruction sw{Store, "r" + to_string(to_decimalism(Binary_instruction.substr(6, 5))), "r" + to_string(to_decimalism(Binary_instruction.substr(11, 5))), "r0", to_decimalism(Binary_instruction.substr(16, 16))};
-        InstructionMemory.push_back(sw);
+        cout << "The breakpoint position must be a multiple of 4 that is not less than 0 and does not exceed the boundary" << endl;
+        return;
     }
-    if (Binary_instruction.substr(0, 6) == "000000" && Binary_instruction.substr(26, 6) == "100000")
+    if (stage != 0 && stage != 1 && stage != 2 && stage != 3 && stage != 4)
     {
-        Instruction add{Add, "r" + to_string(to_decimalism(Binary_instruction.substr(6, 5))), "r" + to_string(to_decimalism(Binary_instruction.substr(11, 5))), "r" + to_string(to_decimalism(Binary_instruction.substr(16, 5))), 0};
-        InstructionMemory.push_back(add);
+        cout << "The stage must be an integer not less than 0 but less than 5" << endl;
+        return;
     }
-    if (Binary_instruction.substr(0, 6) == "000001" && Binary_instruction.substr(11, 5) == "00010")
+    auto reached = [&](const Simulator &s)
     {
-        Instruction beqz{Beqz, "r" + to_string(to_decimalism(Binary_instruction.substr(6, 5))), "r0", "r0", to_decimalism(Binary_instruction.substr(16, 16))};
-        InstructionMemory.push_back(beqz);
-    }
-    if (Binary_instruction == "00000000000000000000000000000000")
+        for (const Instructions_in_pipeline &i : s.pipeline())
+            if (i.pc == breakpoint && i.stage == stage)
+                return true;
+        return false;
+    };
+    sim.run_until(reached);
+    if (reached(sim))
+        cout << stagename[stage] << "-Stage: Reached at the breakpoint" << endl;
+    else
+        cout << "This program has completed execution." << endl;
+}
+
+// Instruction e
+// Execute to the end of the program
+void Execute_to_end()
+{
+    if (!sim.loaded())
     {
-        Instruction nop{Nop};
-        InstructionMemory.push_back(nop);
+        cout << "Please load the program." << endl;
+        return;
     }
+    sim.run();
+    cout << "This program has completed execution." << endl;
 }
 
-// Program initialization
-void program_Init()
+// Instruction sr
+// Output the register status
+void Show_Register(const vector<Register> &Registers = sim.registers())
 {
-    for (int i = 0; i < 1000; i++)
-        for (int j = 0; j < 1000; j++)
-            ClockCycles_Diagram[i][j] = "";
-    ClockCycles_Diagram[0][0] = "Instruction/Cycles";
     for (int i = 0; i < 32; i++)
     {
-        string r = "r";
-        string num = to_string(i);
-        RegisterFile[i] = {r + num, 0, false};
-    }
-    RegisterFile_else.clear();
-    pipline.clear();
-    memset(DataMemory, 0, sizeof(DataMemory));
-
-    pc = 0;
-    Instruction_num = 1;
-    ClockCycles = 0;
-    StallCycles = 0;
-    has_end = false;
-    stall = false;
-
-    Instruction Ir;
-    if_id = {0, Ir};
-    id_ex = {0, 0, 0, Ir};
-    ex_mem = {0, 0, Ir};
-    mem_wb = {0, 0, Ir};
-
-    RegisterFile[1].value = 1;
-    RegisterFile[2].value = 2;
+        if (i != 0 && i % 4 == 0)
+            cout << endl;
+        cout << Registers[i].name << ": " << Registers[i].value << " ";
+    }
+    cout << endl;
 }
 
-// Instruction standard representation
-string Standard_Instruction(Instruction ir)
+// Append text to the diagram buffer, left aligned in a column of the given width
+void Diagram_pad(string &buf, const char *text, size_t width)
 {
-    string S_ir = "";
-    switch (ir.type)
-    {
-    case Load:
-        S_ir = "lw " + ir.rt + "," + to_string(ir.imm) + "(" + ir.rs + ")";
-        break;
-    case Store:
-        S_ir = "sw " + to_string(ir.imm) + "(" + ir.rs + ")" + "," + ir.rt;
-        break;
-    case Beqz:
-        S_ir = "beqz " + ir.rs + "," + to_string(ir.imm);
-        break;
-    case Add:
-        S_ir = "add " + ir.rd + "," + ir.rs + "," + ir.rt;
-        break;
-    case Nop:
-        S_ir = "nop";
-    default:
-        break;
-    }
-    return S_ir;
+    size_t len = strlen(text);
+    buf.append(text, len);
+    if (len < width)
+        buf.append(width - len, ' ');
 }
 
-// Register read
-int readRegister(string regName)
+// Output rows [row_begin, row_end) of the clockcycle diagram within clockcycles [from, to].
+// An empty window (from > to, e.g. past the current clockcycle) outputs the header only.
+void Diagram_render(int row_begin, int row_end, int from, int to)
 {
-    for (int i = 0; i < (int)RegisterFile.size(); i++)
-    {
-        if (RegisterFile[i].name == regName)
+    string buf;
+    size_t cycles = max(to - from + 1, 0);
+    buf.reserve((size_t)(row_end - row_begin + 1) * (25 + cycles * 7 + 1) + 1);
+    Diagram_pad(buf, "Instruction/Cycles", 25);
+    for (int j = from; j <= to; j++)
+        Diagram_pad(buf, to_string(j).c_str(), 7);
+    buf += '\n';
+    for (int i = row_begin; i < row_end; i++)
+    {
+        const DiagramRow &row = sim.diagram()[i];
+        Diagram_pad(buf, row.instruction.c_str(), 25);
+        for (int j = from; j <= to; j++)
         {
-            return RegisterFile[i].value;
+            int k = j - row.first_cycle;
+            Diagram_pad(buf, k >= 0 && k < (int)row.cells.size() ? cellname[(int)row.cells[k]] : "", 7);
         }
+        buf += '\n';
     }
-    if (Forwarding)
-    {
-        for (int i = 0; i < (int)RegisterFile_else.size(); i++)
+    buf += '\n';
+    cout.write(buf.data(), buf.size());
+    cout.flush();
+}
+
+// Instruction sd
+// Output clockcycle diagram
+// sd                        the whole diagram
+// sd from_cycle to_cycle     clockcycles [from_cycle, to_cycle]
+// sd last n                  the last n instructions
+// sd new                     the clockcycles since the last sd
+void Show_Diagram()
+{
+    string line, mode;
+    getline(cin, line);
+    istringstream in(line);
+    const vector<DiagramRow> &diagram = sim.diagram();
+    int ClockCycles = sim.stats().ClockCycles;
+    int rows = diagram.size();
+    int from = 1, to = ClockCycles;
+    int row_begin = 0;
+    if (in >> mode)
+    {
+        if (mode == "new")
+            from = Diagram_shown + 1;
+        else if (mode == "last")
         {
-            if (RegisterFile_else[i].name == regName)
+            int n;
+            if (!(in >> n) || n <= 0)
             {
-                return RegisterFile_else[i].value;
+                cout << "The number of instructions must be a positive integer" << endl;
+                return;
             }
+            row_begin = max(rows - n, 0);
+            if (row_begin < rows)
+                from = diagram[row_begin].first_cycle;
         }
-    }
-
-    return -1;
-}
-
-// Register write
-void writeRegister(string regName, int value)
-{
-    for (int i = 0; i < (int)RegisterFile.size(); i++)
-    {
-        if (RegisterFile[i].name == regName)
+        else
         {
-            RegisterFile[i].value = value;
-            return;
+            istringstream window(line);
+            if (!(window >> from >> to) || from < 1 || from > to)
+            {
+                cout << "The window must be two clockcycles with 1 <= from_cycle <= to_cycle" << endl;
+                return;
+            }
+            to = min(to, ClockCycles);
         }
     }
+    Diagram_shown = ClockCycles;
+
+    // Instructions flow through the pipeline in order, so the rows overlapping the window are contiguous.
+    auto first = partition_point(diagram.begin() + row_begin, diagram.end(), [&](const DiagramRow &row)
+                                 { return row.first_cycle + (int)row.cells.size() - 1 < from; });
+    auto last = partition_point(first, diagram.end(), [&](const DiagramRow &row)
+                                { return row.first_cycle <= to; });
+    Diagram_render(first - diagram.begin(), last - diagram.begin(), from, to);
 }
 
-// Instructions flowing out to the pipline
-void Instruction_outflow()
+// Instruction ss
+// Outputs statisticas
+void Show_Stastistics()
 {
-    Instructions_in_pipeline I = {InstructionMemory[pc / 4], pc, 0, Instruction_num};
-    Instruction_num++;
-    pipline.push_back(I);
-    ClockCycles_Diagram[I.order][0] = Standard_Instruction(I.ir);
+    Statistics stats = sim.stats();
+    cout << "ClockCycles: " << stats.ClockCycles << endl;
+    cout << "StallCycles: " << stats.StallCycles << endl;
 }
 
-/*
-The instruction format
-load：rt  <-  rs+offset
-op-code:100000    rs=base(5 bit)     rt(5 bit)      offset(16 bit)
-
-store: rt  ->  rs+offset
-op-code:101000    rs=base(5 bit)     rt(5 bit)      offset(16 bit)
-
-add: rd  <-  rs+rt
-op_code:000000    rs(5 bit)    rt(5 bit)   rd(5 bit)   0(5 bit)   func:100000
-
-beqz: if(rs==0)  pc=offset
-op_code:000001    rs(5 bit)    beqz:00010   offset(16 bit)
-
-
-*/
-
-// Operations of the IF stage.
-void IF()
+// Export statistics and registers. Files ending in .csv are written as CSV, others as JSON.
+bool Export_statistics(string path)
 {
-    if (stall)
-        return;
-    if_id.ir = InstructionMemory[pc / 4];
-    if (if_id.ir.type == Beqz && readRegister(if_id.ir.rs) == 0)
+    ExportFile out(path);
+    if (!out.out.is_open())
     {
-        pc = pc + if_id.ir.imm;
-        if_id.npc = pc;
+        cout << "Failed to write the file." << endl;
+        return false;
     }
-    else
+    Statistics stats = sim.stats();
+    vector<Register> RegisterFile = sim.registers();
+    bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    if (csv)
     {
-        pc += 4;
-        if_id.npc = pc;
+        out << "name,value\n";
+        out << "ClockCycles," << stats.ClockCycles << "\n";
+        out << "StallCycles," << stats.StallCycles << "\n";
+        out << "Instructions," << stats.Instructions << "\n";
+        out << "Forwarding," << sim.forwarding() << "\n";
+        for (int i = 0; i < 32; i++)
+            out << RegisterFile[i].name << "," << RegisterFile[i].value << "\n";
     }
-    switch (if_id.ir.type)
+    else
     {
-    case Load:
+        out << "{\"ClockCycles\":" << stats.ClockCycles;
+        out << ",\"StallCycles\":" << stats.StallCycles;
+        out << ",\"Instructions\":" << stats.Instructions;
+        out << ",\"Forwarding\":" << (sim.forwarding() ? "true" : "false");
+        out << ",\"Registers\":{";
         for (int i = 0; i < 32; i++)
-        {
-            if (RegisterFile[i].name == if_id.ir.rs && RegisterFile[i].writing == true)
-                stall = true;
-        }
-        break;
-    case Store:
-        for (int i = 0; i < 32; i++)
-        {
-            if (RegisterFile[i].name == if_id.ir.rt && RegisterFile[i].writing == true)
-                stall = true;
-        }
-        break;
-    case Add:
-        for (int i = 0; i < 32; i++)
-        {
-            if (RegisterFile[i].name == if_id.ir.rs && RegisterFile[i].writing == true)
-                stall = true;
-            if (RegisterFile[i].name == if_id.ir.rt && RegisterFile[i].writing == true)
-                stall = true;
-        }
-        break;
-    default:
-        break;
+            out << (i ? "," : "") << "\"" << RegisterFile[i].name << "\":" << RegisterFile[i].value;
+        out << "}}\n";
     }
+    return out.finish();
 }
 
-// Operations of the ID stage.
-void ID()
+// Export the clockcycle diagram as Chrome trace events. Each instruction is a track, each stage a slice of one
+// microsecond per clockcycle; consecutive stall cycles are merged into one slice.
+bool Export_trace(string path)
 {
-    if (!Forwarding)
+    ExportFile out(path);
+    if (!out.out.is_open())
     {
-        id_ex.alu_a = readRegister(if_id.ir.rs);
-        id_ex.alu_b = readRegister(if_id.ir.rt);
-        id_ex.ir = if_id.ir;
-        id_ex.imm = if_id.ir.imm;
+        cout << "Failed to write the file." << endl;
+        return false;
     }
-    else
+    out << "{\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"MIPS pipeline\"}}";
+    const vector<DiagramRow> &diagram = sim.diagram();
+    for (int i = 0; i < (int)diagram.size(); i++)
     {
-        switch (if_id.ir.type)
+        const DiagramRow &row = diagram[i];
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i + 1
+            << ",\"args\":{\"name\":\"" << to_string(i + 1) + ": " + row.instruction << "\"}}";
+        out << ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i + 1
+            << ",\"args\":{\"sort_index\":" << i + 1 << "}}";
+        for (int k = 0, len; k < (int)row.cells.size(); k += len)
         {
-        case Load:
-        {
-            id_ex.alu_b = readRegister(if_id.ir.rt);
-            id_ex.ir = if_id.ir;
-            id_ex.imm = if_id.ir.imm;
-            for (int i = 0; i < 32; i++)
-            {
-                if (RegisterFile[i].name == if_id.ir.rs && RegisterFile[i].writing == true)
-                    id_ex.alu_a = readRegister(if_id.ir.rs + "_else");
-                else
-                    id_ex.alu_a = readRegister(if_id.ir.rs);
-            }
-            break;
+            for (len = 1; k + len < (int)row.cells.size() && row.cells[k + len] == row.cells[k]; len++)
+                ;
+            if (row.cells[k] == BlankCell)
+                continue;
+            out << ",\n{\"name\":\"" << cellname[(int)row.cells[k]] << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << i + 1
+                << ",\"ts\":" << row.first_cycle + k << ",\"dur\":" << len << "}";
         }
+    }
+    out << "\n]}\n";
+    return out.finish();
+}
 
-        case Store:
+// Instruction es
+// Export statistics
+void Export_Stastistics()
+{
+    string path;
+    getline(cin, path);
+    path.erase(0, 1);
+    if (Export_statistics(path))
+        cout << "Statistics exported to " << path << endl;
+}
+
+// Instruction et
+// Export clockcycle diagram as a Chrome trace
+void Export_Diagram()
+{
+    string path;
+    getline(cin, path);
+    path.erase(0, 1);
+    if (Export_trace(path))
+        cout << "Trace exported to " << path << endl;
+}
+
+// Instruction f
+// Changes the forwarding status
+void Forwarding_Change()
+{
+    sim.set_forwarding(!sim.forwarding());
+    Diagram_shown = 0;
+    if (sim.forwarding())
+        cout << "Enable Forwarding. The program will stop running and reinitialize." << endl;
+    else
+        cout << "Disable Forwarding. The program will stop running and reinitialize." << endl;
+}
+
+// Instruction mc
+// Run one program per core on shared data memory
+void Multicore_run()
+{
+    string line, path;
+    vector<string> paths;
+    getline(cin, line);
+    istringstream in(line);
+    while (in >> quoted(path))
+        paths.push_back(path);
+    if (paths.empty())
+    {
+        cout << "Please input the programs of the cores." << endl;
+        return;
+    }
+    auto start = chrono::steady_clock::now();
+    vector<int> memory;
+    vector<CoreResult> result = Multicore_execute(paths, sim.forwarding(), &memory);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long cycles = 0;
+    for (int i = 0; i < (int)result.size(); i++)
+    {
+        cycles += result[i].ClockCycles;
+        if (!result[i].loaded)
+            cout << "Failed to read the file." << endl;
+        cout << "Core " << i << ": " << result[i].file_path << endl;
+        if (result[i].loaded && !result[i].finished)
+            cout << "The program did not finish in " << result[i].ClockCycles << " clockcycles." << endl;
+        cout << "ClockCycles: " << result[i].ClockCycles << endl;
+        cout << "StallCycles: " << result[i].StallCycles << endl;
+        cout << "L1 hits: " << result[i].hits << " misses: " << result[i].misses << " upgrades: " << result[i].upgrades
+             << " invalidations: " << result[i].invalidations << " writebacks: " << result[i].writebacks << endl;
+        Show_Register(result[i].RegisterFile);
+    }
+    // Shared data memory, nonzero words only
+    cout << "Memory:";
+    int shown = 0;
+    for (int i = 0; i < (int)memory.size(); i++)
+        if (memory[i] != 0)
         {
-            id_ex.ir = if_id.ir;
-            id_ex.imm = if_id.ir.imm;
-            for (int i = 0; i < 32; i++)
-            {
-                if (RegisterFile[i].name == if_id.ir.rs && RegisterFile[i].writing == true)
-                    id_ex.alu_a = readRegister(if_id.ir.rs + "_else");
-                else
-                    id_ex.alu_a = readRegister(if_id.ir.rs);
-                if (RegisterFile[i].name == if_id.ir.rt && RegisterFile[i].writing == true)
-                    id_ex.alu_b = readRegister(if_id.ir.rt + "_else");
-                else
-                    id_ex.alu_b = readRegister(if_id.ir.rt);
-            }
-            break;
+            if (shown != 0 && shown % 8 == 0)
+                cout << endl << "       ";
+            cout << " [" << i << "] " << memory[i];
+            shown++;
         }
+    if (shown == 0)
+        cout << " all zero";
+    cout << endl;
+    cout << result.size() << " cores, " << cycles << " clockcycles in " << seconds << " s, "
+         << (long)(cycles / max(seconds, 1e-9)) << " clockcycles/s" << endl;
+}
 
-        case Add:
+// Generate a random program. The same seed and parameters always give the same program.
+// Only forward branches are generated and r0 is never written, so every program terminates
+// and lw/sw based on r0 stay within the first footprint words of data memory.
+vector<uint32_t> Program_generate(unsigned seed, const GeneratorConfig &config)
+{
+    mt19937 rng(seed);
+    auto random = [&](int n)
+    { return (int)(rng() % n); };
+    vector<uint32_t> words;
+    vector<int> dest; // Destination register of each instruction, 0 if none
+    auto source = [&]()
+    {
+        int i = (int)dest.size() - config.distance;
+        if (i >= 0 && dest[i] != 0 && random(4) != 0)
+            return (uint32_t)dest[i];
+        return (uint32_t)random(32);
+    };
+    for (int i = 0; i < config.length; i++)
+    {
+        int kind = random(100) < config.branch ? 3 : random(config.footprint > 0 ? 3 : 1);
+        uint32_t rd = 1 + random(31);
+        switch (kind)
         {
-            id_ex.ir = if_id.ir;
-            id_ex.imm = if_id.ir.imm;
-            for (int i = 0; i < 32; i++)
-            {
-                if (RegisterFile[i].name == if_id.ir.rs)
-                {
-                    if (RegisterFile[i].writing == true)
-                        id_ex.alu_a = readRegister(if_id.ir.rs + "_else");
-                    else
-                        id_ex.alu_a = readRegister(if_id.ir.rs);
-                }
-                if (RegisterFile[i].name == if_id.ir.rt)
-                {
-                    if (RegisterFile[i].writing == true)
-                        id_ex.alu_b = readRegister(if_id.ir.rt + "_else");
-                    else
-                        id_ex.alu_b = readRegister(if_id.ir.rt);
-                }
-            }
+        // Each draw is its own statement, so the generator is consumed in the same order by every compiler.
+        case 0: // add
+        {
+            uint32_t rs = source();
+            uint32_t rt = source();
+            words.push_back(rs << 21 | rt << 16 | rd << 11 | 0x20);
+            dest.push_back(rd);
             break;
         }
-
-        case Beqz:
+        case 1: // lw
         {
-            id_ex.alu_b = readRegister(if_id.ir.rt);
-            id_ex.ir = if_id.ir;
-            id_ex.imm = if_id.ir.imm;
-            for (int i = 0; i < 32; i++)
-            {
-                if (RegisterFile[i].name == if_id.ir.rs && RegisterFile[i].writing == true)
-                    id_ex.alu_a = readRegister(if_id.ir.rs + "_else");
-                else
-                    id_ex.alu_a = readRegister(if_id.ir.rs);
-            }
+            uint32_t offset = random(config.footprint);
+            words.push_back(0x20u << 26 | rd << 16 | offset);
+            dest.push_back(rd);
             break;
         }
-
-        default:
+        case 2: // sw
+        {
+            uint32_t rt = source();
+            uint32_t offset = random(config.footprint);
+            words.push_back(0x28u << 26 | rt << 16 | offset);
+            dest.push_back(0);
             break;
         }
-    }
-    if (if_id.ir.type == Load)
-    {
-        for (int i = 0; i < 32; i++)
+        default: // beqz
         {
-            if (RegisterFile[i].name == if_id.ir.rt)
-                RegisterFile[i].writing = true;
+            uint32_t rs = source();
+            uint32_t offset = 4 * (1 + random(min(4, config.length - i)));
+            words.push_back(0x01u << 26 | rs << 21 | 2 << 16 | offset);
+            dest.push_back(0);
+            break;
         }
-    }
-    if (if_id.ir.type == Add)
-    {
-        for (int i = 0; i < 32; i++)
-        {
-            if (RegisterFile[i].name == if_id.ir.rd)
-                RegisterFile[i].writing = true;
         }
     }
+    return words;
 }
 
-// Operations of the EX stage.
-void EX()
+// Register index of a register name
+int Register_index(const string &name)
 {
-    ex_mem.ir = id_ex.ir;
-    if (id_ex.ir.type == Add)
-    {
-        ex_mem.alu_o = id_ex.alu_a + id_ex.alu_b;
-        if (Forwarding)
-        {
-            Register Reg;
-            Reg.name = ex_mem.ir.rd + "_else";
-            Reg.value = ex_mem.alu_o;
-            RegisterFile_else.push_back(Reg);
-            stall = false;
-        }
-    }
-    else if (id_ex.ir.type == Load || id_ex.ir.type == Store)
-    {
-        ex_mem.alu_o = id_ex.alu_a + id_ex.imm;
-        ex_mem.alu_b = id_ex.alu_b;
-    }
+    return stoi(name.substr(1));
 }
 
-// Operations of the MEM stage.
-void MEM()
+// Execute a program instruction by instruction, without modelling the pipeline.
+// Returns false if it did not finish within max_steps.
+bool Reference_execute(const vector<Instruction> &program, int reg[32], int mem[1000], int max_steps)
 {
-    mem_wb.ir = ex_mem.ir;
-    if (ex_mem.ir.type == Add)
-    {
-        mem_wb.alu_o = ex_mem.alu_o;
-    }
-    else if (ex_mem.ir.type == Load)
-    {
-        mem_wb.lmd = DataMemory[ex_mem.alu_o];
-        if (Forwarding)
+    memset(reg, 0, 32 * sizeof(int));
+    memset(mem, 0, 1000 * sizeof(int));
+    reg[1] = 1;
+    reg[2] = 2;
+    int pc = 0;
+    for (int step = 0; pc / 4 < (int)program.size(); step++)
+    {
+        if (step == max_steps)
+            return false;
+        const Instruction &ir = program[pc / 4];
+        int rs = reg[Register_index(ir.rs)];
+        int rt = Register_index(ir.rt);
+        switch (ir.type)
         {
-            Register Reg;
-            Reg.name = mem_wb.ir.rt + "_else";
-            Reg.value = mem_wb.lmd;
-            RegisterFile_else.push_back(Reg);
-            stall = false;
+        case Load:
+            reg[rt] = mem[rs + ir.imm];
+            break;
+        case Store:
+            mem[rs + ir.imm] = reg[rt];
+            break;
+        case Add:
+            reg[Register_index(ir.rd)] = rs + reg[rt];
+            break;
+        case Beqz:
+            if (rs == 0)
+            {
+                pc += ir.imm;
+                continue;
+            }
+            break;
+        default:
+            break;
         }
+        pc += 4;
     }
-    else if (ex_mem.ir.type == Store)
-    {
-        DataMemory[ex_mem.alu_o] = ex_mem.alu_b;
-    }
+    return true;
 }
 
-// Operations of the WB stage.
-void WB()
+// Run a program on a pipeline and compare it with the reference.
+// Returns an empty string if they agree, otherwise a description of the first difference.
+string Fuzz_check(Simulator &pipeline, const vector<uint32_t> &words, const int reg[32], const int mem[1000], int max_cycles)
 {
-    if (mem_wb.ir.type == Add)
-    {
-        writeRegister(mem_wb.ir.rd, mem_wb.alu_o);
-        for (int i = 0; i < 32; i++)
-        {
-            if (RegisterFile[i].name == mem_wb.ir.rd && RegisterFile[i].writing == true)
-                RegisterFile[i].writing = false;
-        }
-    }
-    else if (mem_wb.ir.type == Load)
-    {
-        writeRegister(mem_wb.ir.rt, mem_wb.lmd);
-        for (int i = 0; i < 32; i++)
-        {
-            if (RegisterFile[i].name == mem_wb.ir.rt && RegisterFile[i].writing == true)
-                RegisterFile[i].writing = false;
-        }
-    }
-    if (!Forwarding)
-        stall = false;
+    pipeline.load(words);
+    pipeline.step(max_cycles);
+    if (!pipeline.finished())
+        return "did not finish in " + to_string(max_cycles) + " clockcycles";
+    vector<Register> RegisterFile = pipeline.registers();
+    const int *memory = pipeline.memory();
+    for (int i = 0; i < 32; i++)
+        if (RegisterFile[i].value != reg[i])
+            return RegisterFile[i].name + " = " + to_string(RegisterFile[i].value) + ", expected " + to_string(reg[i]);
+    for (int i = 0; i < 1000; i++)
+        if (memory[i] != mem[i])
+            return "memory[" + to_string(i) + "] = " + to_string(memory[i]) + ", expected " + to_string(mem[i]);
+    return "";
 }
 
-// Instruction fr
-// Read the file
-void File_read()
+// Run a program on a pipeline and summarise its result for a baseline: the statistics and a hash of registers and memory
+string Fuzz_outcome(Simulator &pipeline, const vector<uint32_t> &words, int max_cycles)
+{
+    pipeline.load(words);
+    pipeline.step(max_cycles);
+    if (!pipeline.finished())
+        return "unfinished";
+    uint64_t hash = 14695981039346656037ull; // FNV-1a
+    auto mix = [&](int value)
+    {
+        for (int k = 0; k < 4; k++)
+            hash = (hash ^ ((uint32_t)value >> (8 * k) & 0xFF)) * 1099511628211ull;
+    };
+    for (const Register &r : pipeline.registers())
+        mix(r.value);
+    for (int i = 0; i < 1000; i++)
+        mix(pipeline.memory()[i]);
+    Statistics stats = pipeline.stats();
+    ostringstream out;
+    out << stats.ClockCycles << " " << stats.StallCycles << " " << stats.Instructions << " " << hex << hash;
+    return out.str();
+}
+
+// Instruction gs
+// Sets the parameters of the program generator
+void Generator_set()
 {
-    program_Init();
-    getline(cin, file_path);
-    file_path.erase(0, 1);
-    ifstream infile;
-    infile.open(file_path, ios::in);
-    if (!infile.is_open())
+    GeneratorConfig config;
+    cin >> config.length >> config.distance >> config.branch >> config.footprint;
+    if (config.length < 1 || config.distance < 1 || config.branch < 0 || config.branch > 100 || config.footprint < 0 || config.footprint > 1000)
     {
-        cout << "Failed to read the file." << endl;
+        cout << "Expect length >= 1, distance >= 1, 0 <= branch <= 100 and 0 <= footprint <= 1000" << endl;
         return;
     }
-    string buf;
-    while (getline(infile, buf))
-        Instruction_read(buf);
+    Generator = config;
 }
 
-// Instruction n
-// Single step execution
-void Single_step_execution()
+// Instruction gp
+// Writes a generated program to a file
+void Generate_program()
 {
-    if (InstructionMemory.empty())
+    unsigned seed;
+    string path;
+    cin >> seed;
+    getline(cin, path);
+    path.erase(0, 1);
+    ExportFile out(path);
+    if (!out.out.is_open())
     {
-        cout << "Please load the program." << endl;
+        cout << "Failed to write the file." << endl;
         return;
     }
-    if (has_end)
-    {
-        cout << "This program has completed execution." << endl;
+    for (uint32_t word : Program_generate(seed, Generator))
+        out << bitset<32>(word).to_string() << "\n";
+    out.finish();
+}
+
+// Instruction fz
+// Differential fuzzing: runs generated programs with forwarding off and on and compares them with the reference.
+// With a baseline file, compares them with the results recorded in it instead, so only changes of the pipeline are
+// reported; the file is recorded on the first run.
+void Fuzz()
+{
+    int count;
+    unsigned seed;
+    string path;
+    cin >> count >> seed;
+    getline(cin, path);
+    path.erase(0, path.find_first_not_of(' '));
+    if (count <= 0)
+    {
+        cout << "The number of programs must be a positive integer" << endl;
         return;
     }
-    bool has_add = false;
-    bool true_stall = false;
-    if (pipline.empty() && pc / 4 < (int)InstructionMemory.size())
-    {
-        Instruction_outflow();
-        has_add = true;
-    }
-    ClockCycles++;
-    ClockCycles_Diagram[0][ClockCycles] = to_string(ClockCycles);
-    for (auto i = pipline.begin(); i != pipline.end();)
-    {
-        switch (i->stage)
-        {
-        case If:
-        {
-            IF();
-            ClockCycles_Diagram[i->order][ClockCycles] = stagename[i->stage];
-            i->stage++;
-            i++;
-            break;
-        }
-
-        case Id:
+    int max_steps = Generator.length;
+    int max_cycles = 20 * Generator.length + 100;
+    bool baseline = !path.empty();
+    vector<string> outcome(2 * count); // Result of program i with forwarding f at 2 * i + f, for a baseline
+    atomic<int> next(0);
+    atomic<int> failed(0);
+    mutex report_lock;
+    vector<pair<unsigned, string>> report;
+    auto worker = [&]()
+    {
+        Simulator pipeline[2] = {Simulator(false), Simulator(true)};
+        int reg[32], mem[1000];
+        for (int i; (i = next++) < count;)
         {
-            if (!stall)
+            vector<uint32_t> words = Program_generate(seed + i, Generator);
+            if (baseline)
             {
-                ID();
-                ClockCycles_Diagram[i->order][ClockCycles] = stagename[i->stage];
-                i->stage++;
+                for (int forwarding = 0; forwarding < 2; forwarding++)
+                    outcome[2 * i + forwarding] = Fuzz_outcome(pipeline[forwarding], words, max_cycles);
+                continue;
             }
-            else
+            vector<Instruction> program;
+            for (uint32_t word : words)
+                program.push_back(Instruction_decode(word));
+            if (!Reference_execute(program, reg, mem, max_steps))
             {
-                ClockCycles_Diagram[i->order][ClockCycles] = "Stall";
-                true_stall = true;
+                failed++;
+                lock_guard<mutex> lock(report_lock);
+                report.push_back({seed + i, "Seed " + to_string(seed + i) + ": the reference did not finish in " + to_string(max_steps) + " instructions"});
+                continue;
             }
-
-            if (!has_add && !stall && pc / 4 < (int)InstructionMemory.size())
+            for (int forwarding = 0; forwarding < 2; forwarding++)
             {
-                Instruction_outflow();
-                has_add = true;
+                string diff = Fuzz_check(pipeline[forwarding], words, reg, mem, max_cycles);
+                if (diff.empty())
+                    continue;
+                failed++;
+                lock_guard<mutex> lock(report_lock);
+                report.push_back({seed + i, "Seed " + to_string(seed + i) + (forwarding ? ", forwarding: " : ": ") + diff});
             }
-            i++;
-            break;
         }
-
-        case Ex:
+    };
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    int n = max(1u, thread::hardware_concurrency());
+    for (int i = 0; i < n; i++)
+        threads.emplace_back(worker);
+    for (int i = 0; i < n; i++)
+        threads[i].join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (baseline)
+    {
+        // The first line names the programs: count, seed and generator parameters.
+        ostringstream programs;
+        programs << count << " " << seed << " " << Generator.length << " " << Generator.distance << " " << Generator.branch << " " << Generator.footprint;
+        ifstream in(path);
+        if (!in.is_open())
         {
-            EX();
-            ClockCycles_Diagram[i->order][ClockCycles] = stagename[i->stage];
-            i->stage++;
-            if (!has_add && !stall && pc / 4 < (int)InstructionMemory.size())
+            ExportFile out(path);
+            if (!out.out.is_open())
             {
-                Instruction_outflow();
-                has_add = true;
+                cout << "Failed to write the file." << endl;
+                return;
             }
-            i++;
-            break;
+            out << programs.str() << "\n";
+            for (int i = 0; i < 2 * count; i++)
+                out << outcome[i] << "\n";
+            if (out.finish())
+                cout << "Baseline of " << count << " programs recorded to " << path << endl;
+            return;
         }
-
-        case Mem:
+        string line;
+        if (!getline(in, line) || line != programs.str())
         {
-            MEM();
-            ClockCycles_Diagram[i->order][ClockCycles] = stagename[i->stage];
-            i->stage++;
-            if (!has_add && !stall && pc / 4 < (int)InstructionMemory.size())
-            {
-                Instruction_outflow();
-                has_add = true;
-            }
-            i++;
-            break;
+            cout << "The baseline was recorded for other programs: " << line << endl;
+            return;
         }
-
-        case Wb:
+        for (int i = 0; i < 2 * count; i++)
         {
-            WB();
-            ClockCycles_Diagram[i->order][ClockCycles] = stagename[i->stage];
-            i->stage++;
-            auto j = ++i;
-            pipline.erase(--i);
-            i = j;
-            if (!has_add && !stall && pc / 4 < (int)InstructionMemory.size())
-            {
-                Instruction_outflow();
-                has_add = true;
-            }
-            break;
-        }
-
-        default:
-            break;
+            if (!getline(in, line))
+                line = "missing";
+            if (line == outcome[i])
+                continue;
+            failed++;
+            report.push_back({seed + i / 2, "Seed " + to_string(seed + i / 2) + (i % 2 ? ", forwarding: " : ": ") + "baseline " + line + ", now " + outcome[i]});
         }
     }
-    if (true_stall)
-        StallCycles++;
-    if (pipline.empty())
-        has_end = true;
+
+    sort(report.begin(), report.end());
+    for (int i = 0; i < (int)report.size() && i < 10; i++)
+        cout << report[i].second << endl;
+    cout << count << " programs, " << failed << (baseline ? " changes from the baseline, " : " mismatches, ")
+         << (int)(count / seconds) << " programs/s on " << n << " threads" << endl;
 }
 
-// Instruction b
-// Sets and executes to a breakpoint
-void Execute_to_breakpoint()
+// Instruction bs
+// Runs the loaded program in one lane per initial value from..to of a register
+void Batch_sweep()
 {
-    if (InstructionMemory.empty())
+    int reg, from, to;
+    cin >> reg >> from >> to;
+    if (!sim.loaded())
     {
         cout << "Please load the program." << endl;
         return;
     }
-    int breakpoint;
-    int stage;
-    cin >> breakpoint >> stage;
-    if (breakpoint % 4 != 0 || breakpoint < 0 || breakpoint / 4 >= (int)InstructionMemory.size())
+    if (reg < 0 || reg > 31 || from > to || (long)to - from >= BatchSimulator::MaxLanes)
     {
-        cout << "The breakpoint position must be a multiple of 4 that is not less than 0 and does not exceed the boundary" << endl;
+        cout << "Expect 0 <= reg <= 31 and from <= to, with at most " << BatchSimulator::MaxLanes << " values" << endl;
         return;
     }
-    if (stage != 0 && stage != 1 && stage != 2 && stage != 3 && stage != 4)
+    int lanes = to - from + 1;
+    unique_ptr<BatchSimulator> batch;
+    try
     {
-        cout << "The stage must be an integer not less than 0 but less than 5" << endl;
-        return;
+        batch.reset(new BatchSimulator(lanes, sim.forwarding()));
     }
-    while (1)
-    {
-        for (auto i = pipline.begin(); i != pipline.end(); i++)
-        {
-            if (i->pc == breakpoint && i->stage == stage)
-            {
-                cout << stagename[stage] << "-Stage: Reached at the breakpoint" << endl;
-                return;
-            }
-        }
-        Single_step_execution();
-    }
-}
-
-// Instruction e
-// Execute to the end of the program
-void Execute_to_end()
-{
-    if (InstructionMemory.empty())
+    catch (const bad_alloc &)
     {
-        cout << "Please load the program." << endl;
+        cout << "Not enough memory for " << lanes << " lanes." << endl;
         return;
     }
-    while (!has_end)
-        Single_step_execution();
-    cout << "This program has completed execution." << endl;
-}
-
-// Instruction sr
-// Output the register status
-void Show_Register()
-{
-    for (int i = 0; i < 32; i++)
-    {
-        if (i != 0 && i % 4 == 0)
-            cout << endl;
-        cout << RegisterFile[i].name << ": " << RegisterFile[i].value << " ";
-    }
-    cout << endl;
-}
-
-// Instruction sd
-// Output clockcycle diagram
-void Show_Diagram()
-{
-    for (int i = 0; i < Instruction_num; i++)
-    {
-        cout << setw(25) << setiosflags(ios::left) << ClockCycles_Diagram[i][0];
-        for (int j = 1; j <= ClockCycles; j++)
-        {
-            cout << setw(7) << setiosflags(ios::left) << ClockCycles_Diagram[i][j];
-        }
-        cout << endl;
-    }
-    cout << endl;
-}
-
-// Instruction ss
-// Outputs statisticas
-void Show_Stastistics()
-{
-    cout << "ClockCycles: " << ClockCycles << endl;
-    cout << "StallCycles: " << StallCycles << endl;
-}
-
-// Instruction f
-// Changes the forwarding status
-void Forwarding_Change()
-{
-    Forwarding = !Forwarding;
-    if (Forwarding)
-        cout << "Enable Forwarding. The program will stop running and reinitialize." << endl;
-    else
-        cout << "Disable Forwarding. The program will stop running and reinitialize." << endl;
-    program_Init();
+    batch->load(sim);
+    for (int i = 0; i < lanes; i++)
+        batch->set_register(i, reg, from + i);
+    auto start = chrono::steady_clock::now();
+    long cycles = batch->step(Max_clockcycles);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    for (int i = 0; i < lanes && i < 16; i++)
+    {
+        Statistics stats = batch->stats(i);
+        cout << "r" << reg << " = " << from + i << ": ClockCycles " << stats.ClockCycles << ", StallCycles " << stats.StallCycles
+             << ", Instructions " << stats.Instructions << endl;
+    }
+    if (lanes > 16)
+        cout << "..." << endl;
+    if (!batch->finished())
+        cout << "Some lanes did not finish in " << Max_clockcycles << " clockcycles." << endl;
+    cout << lanes << " lanes, " << batch->groups() << " control paths, " << cycles << " clockcycles, "
+         << (long)(lanes * (double)cycles / max(seconds, 1e-9)) << " lane clockcycles/s" << endl;
 }
 
 // Instruction h
@@ -747,8 +791,19 @@ void Help()
     cout << "e              Execute to end." << endl;
     cout << "sr             Show registers." << endl;
     cout << "sd             Show cycle diagram." << endl;
+    cout << "sd  from  to   Show cycle diagram within clockcycles [from, to]." << endl;
+    cout << "sd  last  n    Show cycle diagram of the last n instructions." << endl;
+    cout << "sd  new        Show cycle diagram since the last sd." << endl;
     cout << "ss             Show stastistic." << endl;
+    cout << "es file_path   Export stastistic as JSON, or CSV for .csv files." << endl;
+    cout << "et file_path   Export cycle diagram as a Chrome trace." << endl;
     cout << "f              Forwarding change." << endl;
+    cout << "mc file_path.. Run one program per core on shared memory." << endl;
+    cout << "gs len dist branch footprint  Set generator parameters." << endl;
+    cout << "gp seed file_path  Generate a random program." << endl;
+    cout << "fz count seed  Differential fuzzing of generated programs." << endl;
+    cout << "fz count seed file  Compare generated programs with a baseline file, recording it if missing." << endl;
+    cout << "bs reg from to Run the program for each value of a register in SIMD lanes." << endl;
     cout << "q              Quit." << endl;
 }
 
@@ -763,8 +818,15 @@ void interaction()
     5.sd: Show Cycle Diagram
     6.ss: Show Stastistic
     7.f: Forwarding change
-    8.h: print the commands help
-    9.quit
+    8.mc: Multicore execution
+    9.es: Export Stastistic
+    10.et: Export Cycle Diagram
+    11.gs: Set generator parameters
+    12.gp: Generate program
+    13.fz: Differential fuzzing
+    14.bs: Batch register sweep
+    15.h: print the commands help
+    16.quit
     */
 
     while (1)
@@ -796,6 +858,27 @@ void interaction()
         else if (input == "f")
             Forwarding_Change();
 
+        else if (input == "es")
+            Export_Stastistics();
+
+        else if (input == "et")
+            Export_Diagram();
+
+        else if (input == "mc")
+            Multicore_run();
+
+        else if (input == "gs")
+            Generator_set();
+
+        else if (input == "gp")
+            Generate_program();
+
+        else if (input == "fz")
+            Fuzz();
+
+        else if (input == "bs")
+            Batch_sweep();
+
         else if (input == "h")
             Help();
 
@@ -806,8 +889,48 @@ void interaction()
     }
 }
 
-int main()
+// Batch mode: MIPS [-f] [-s stats_path] [-t trace_path] file_path
+// Executes the program to the end and writes the requested exports.
+int batch(int argc, char *argv[])
+{
+    string program, stats, trace;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-f")
+            sim.set_forwarding(true);
+        else if (arg == "-s" && i + 1 < argc)
+            stats = argv[++i];
+        else if (arg == "-t" && i + 1 < argc)
+            trace = argv[++i];
+        else
+            program = arg;
+    }
+    if (program.empty() || !sim.load(program))
+    {
+        cout << "Usage: MIPS [-f] [-s stats_path] [-t trace_path] file_path" << endl;
+        return 1;
+    }
+    if (sim.skipped_lines() != 0)
+        cout << sim.skipped_lines() << " lines of the file are not instructions and were skipped." << endl;
+    sim.step(Max_clockcycles);
+    if (!sim.finished())
+    {
+        cout << "The program did not finish in " << Max_clockcycles << " clockcycles." << endl;
+        return 1;
+    }
+    cout << "This program has completed execution." << endl;
+    if (!stats.empty() && !Export_statistics(stats))
+        return 1;
+    if (!trace.empty() && !Export_trace(trace))
+        return 1;
+    return 0;
+}
+
+int main(int argc, char *argv[])
 {
+    if (argc > 1)
+        return batch(argc, argv);
     interaction();
     return 0;
-}
\ No newline at end of file
+}
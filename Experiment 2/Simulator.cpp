@@ -0,0 +1,1222 @@
+/*
+    Core of the five segment MIPS pipeline simulator, see Simulator.h.
+*/
+
+#include "Simulator.h"
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <vector>
+#include <list>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace mips
+{
+
+// Decode a binary instruction word. Unknown words are treated as nop.
+Instruction Instruction_decode(uint32_t word)
+{
+    string rs = "r" + to_string(word >> 21 & 31);
+    string rt = "r" + to_string(word >> 16 & 31);
+    string rd = "r" + to_string(word >> 11 & 31);
+    int imm = word & 0xFFFF;
+    Instruction nop{Nop};
+    switch (word >> 26)
+    {
+    case 0x20:
+        return {Load, rs, rt, "r0", imm};
+    case 0x28:
+        return {Store, rs, rt, "r0", imm};
+    case 0x00:
+        if ((word & 0x3F) == 0x20)
+            return {Add, rs, rt, rd, 0};
+        break;
+    case 0x01:
+        if ((word >> 16 & 31) == 2)
+            return {Beqz, rs, "r0", "r0", imm};
+        break;
+    default:
+        break;
+    }
+    return nop;
+}
+
+namespace
+{
+
+// Define MESI states of a cache line.
+enum MESIState
+{
+    Invalid = 0,
+    Shared,
+    Exclusive,
+    Modified
+};
+
+// Define the header of a packed binary program image.
+struct ImageHeader
+{
+    char magic[4];
+    uint32_t text_words;
+    uint32_t data_words;
+};
+
+// Define a line of the private L1 data cache.
+// The owning core accesses a valid line without the bus; snoops from other cores take the line lock.
+struct CacheLine
+{
+    MESIState state = Invalid;
+    int tag = -1;
+    int data[4] = {0};
+    mutex lock;
+};
+
+// Define the private L1 data cache of a core (direct-mapped, 16 lines of 4 words).
+struct L1Cache
+{
+    CacheLine line[16];
+    int hits = 0;
+    int misses = 0;
+    int upgrades = 0;
+    int invalidations = 0;
+    int writebacks = 0;
+};
+
+// Define the memory system of one multicore run: the data memory shared by the cores and their private L1 caches.
+// Each run has its own, so runs on different threads do not interfere.
+struct MemorySystem
+{
+    int DataMemory[1000] = {0}; // Data memory, shared by all cores
+    vector<L1Cache> L1;         // Private L1 data caches, one per core
+    mutex Bus;                  // Serializes coherence transactions (misses, upgrades and snoops) between the L1 caches
+
+    MemorySystem(int cores) : L1(cores) {}
+};
+
+// Barrier separating the cycle quanta of the cores.
+struct Barrier
+{
+    mutex m;
+    condition_variable cv;
+    int count;
+    int arrived = 0;
+    int running = 0;
+    int generation = 0;
+    bool all_done = false;
+
+    Barrier(int n) : count(n) {}
+
+    // Returns true once every core has arrived with done set.
+    bool wait(bool done)
+    {
+        unique_lock<mutex> lock(m);
+        int gen = generation;
+        if (!done)
+            running++;
+        if (++arrived == count)
+        {
+            all_done = (running == 0);
+            arrived = 0;
+            running = 0;
+            generation++;
+            cv.notify_all();
+            return all_done;
+        }
+        cv.wait(lock, [&]
+                { return gen != generation; });
+        return all_done;
+    }
+};
+
+// The pipeline state below is per core. Each simulated core runs on its own host thread, so it is thread_local.
+
+// Define the IF_ID pipeline register.
+thread_local struct IF_ID
+{
+    int npc = 0;
+    Instruction ir;
+} if_id;
+
+// Define the ID_EX pipeline register.
+thread_local struct ID_EX
+{
+    int alu_a = 0;
+    int alu_b = 0;
+    int imm = 0;
+    Instruction ir;
+} id_ex;
+
+// Define the EX_MEM pipeline register.
+thread_local struct EX_MEM
+{
+    int alu_o = 0;
+    int alu_b = 0;
+    Instruction ir;
+} ex_mem;
+
+// Define the MEM_WB pipeline register.
+thread_local struct MEM_WB
+{
+    int lmd = 0;
+    int alu_o = 0;
+    Instruction ir;
+} mem_wb;
+
+thread_local vector<Register> RegisterFile(32, {"", 0}); // Register file
+thread_local vector<Instruction> InstructionMemory;      // Instruction memory
+thread_local vector<Register> RegisterFile_else;         // Used for data staging in forwarding
+thread_local list<Instructions_in_pipeline> pipline;     // The pipline
+thread_local int *Data_memory = nullptr;                 // Data memory accessed without L1
+
+thread_local const uint32_t *Image_text = nullptr;            // Text section of the mapped program image
+thread_local int Image_words = 0;                             // Number of instructions in the mapped image
+thread_local void *Image_map = nullptr;                       // The mapping itself
+thread_local size_t Image_size = 0;                           // Size of the mapping
+thread_local unordered_map<int, Instruction> Image_decoded;   // Instructions of the image decoded so far
+thread_local const uint32_t *Image_data = nullptr;            // Data section of the mapped program image
+thread_local int Image_data_words = 0;                        // Number of words in the data section
+thread_local int Skipped_lines = 0;                           // Lines of the program file that are not instructions
+
+thread_local int pc = 0;
+thread_local int Instruction_num = 1;     // Number of instructions that have already flowed out
+thread_local int ClockCycles = 0;         // Number of clockcycles that have already occurred
+thread_local int StallCycles = 0;         // Number of clockcycles paused on the pipline
+thread_local bool has_end = false;        // Whether the program has ended
+thread_local bool stall = false;          // Whether the pipline is paused now
+thread_local vector<DiagramRow> *ClockCycles_Diagram = nullptr; // Clockcycles diagram, if this core records one
+thread_local int core_id = -1;            // Core running on this thread, -1 accesses Data_memory without L1
+thread_local bool Forwarding = false;     // Whether to enable forwarding
+
+thread_local MemorySystem *System = nullptr; // Memory system of the multicore run this core belongs to, if any
+const int Quantum = 100; // Number of clockcycles each core runs between two barriers
+const int Max_core_cycles = 1000000; // A core that has not ended after this many clockcycles is stopped
+
+// Binary instruction processing. A line starts with one 32-bit word in binary, decoded as the words of an image are
+// so both formats give the same program; the rest of the line, such as a comment, is ignored.
+// Other lines that are not blank are skipped and counted.
+void Instruction_read(const string &Binary_instruction)
+{
+    size_t digits = min(Binary_instruction.find_first_not_of("01"), Binary_instruction.size());
+    if (digits == 32)
+        InstructionMemory.push_back(Instruction_decode(stoul(Binary_instruction.substr(0, 32), nullptr, 2)));
+    else if (Binary_instruction.find_first_not_of(" \t\r") != string::npos)
+        Skipped_lines++;
+}
+
+// Core initialization
+void Core_Init()
+{
+    for (int i = 0; i < 32; i++)
+    {
+        string r = "r";
+        string num = to_string(i);
+        RegisterFile[i] = {r + num, 0, false};
+    }
+    RegisterFile_else.clear();
+    pipline.clear();
+
+    pc = 0;
+    Instruction_num = 1;
+    ClockCycles = 0;
+    StallCycles = 0;
+    has_end = false;
+    stall = false;
+
+    Instruction Ir{};
+    if_id = {0, Ir};
+    id_ex = {0, 0, 0, Ir};
+    ex_mem = {0, 0, Ir};
+    mem_wb = {0, 0, Ir};
+
+    RegisterFile[1].value = 1;
+    RegisterFile[2].value = 2;
+}
+
+// Number of instructions in instruction memory
+int Instruction_count()
+{
+    if (Image_text)
+        return Image_words;
+    return InstructionMemory.size();
+}
+
+// Instruction fetch. Instructions of a mapped image are decoded on first fetch.
+const Instruction &Instruction_fetch(int addr)
+{
+    if (!Image_text)
+        return InstructionMemory[addr / 4];
+    auto it = Image_decoded.find(addr / 4);
+    if (it == Image_decoded.end())
+        it = Image_decoded.emplace(addr / 4, Instruction_decode(Image_text[addr / 4])).first;
+    return it->second;
+}
+
+// Add the row of an instruction to the clockcycles diagram
+void Diagram_add(string instruction)
+{
+    if (ClockCycles_Diagram)
+        ClockCycles_Diagram->push_back(DiagramRow{instruction, 0, {}});
+}
+
+// Record a cell of the clockcycles diagram
+void Diagram_record(int order, int cycle, int cell)
+{
+    if (!ClockCycles_Diagram)
+        return;
+    DiagramRow &row = (*ClockCycles_Diagram)[order - 1];
+    if (row.cells.empty())
+        row.first_cycle = cycle;
+    if (cycle - row.first_cycle >= (int)row.cells.size())
+        row.cells.resize(cycle - row.first_cycle + 1, BlankCell);
+    row.cells[cycle - row.first_cycle] = cell;
+}
+
+// Instruction standard representation
+string Standard_Instruction(Instruction ir)
+{
+    string S_ir = "";
+    switch (ir.type)
+    {
+    case Load:
+        S_ir = "lw " + ir.rt + "," + to_string(ir.imm) + "(" + ir.rs + ")";
+        break;
+    case Store:
+        S_ir = "sw " + to_string(ir.imm) + "(" + ir.rs + ")" + "," + ir.rt;
+        break;
+    case Beqz:
+        S_ir = "beqz " + ir.rs + "," + to_string(ir.imm);
+        break;
+    case Add:
+        S_ir = "add " + ir.rd + "," + ir.rs + "," + ir.rt;
+        break;
+    case Nop:
+        S_ir = "nop";
+    default:
+        break;
+    }
+    return S_ir;
+}
+
+// Register read
+int readRegister(string regName)
+{
+    for (int i = 0; i < (int)RegisterFile.size(); i++)
+    {
+        if (RegisterFile[i].name == regName)
+        {
+            return RegisterFile[i].value;
+        }
+    }
+    if (Forwarding)
+    {
+        for (int i = 0; i < (int)RegisterFile_else.size(); i++)
+        {
+            if (RegisterFile_else[i].name == regName)
+            {
+                return RegisterFile_else[i].value;
+            }
+        }
+    }
+
+    return -1;
+}
+
+// Register write
+void writeRegister(string regName, int value)
+{
+    for (int i = 0; i < (int)RegisterFile.size(); i++)
+    {
+        if (RegisterFile[i].name == regName)
+        {
+            RegisterFile[i].value = value;
+            return;
+        }
+    }
+}
+
+// Write a modified cache line back to data memory
+void L1_Writeback(MemorySystem &system, L1Cache &cache, int index)
+{
+    CacheLine &l = cache.line[index];
+    int base = (l.tag * 16 + index) * 4;
+    for (int i = 0; i < 4; i++)
+        system.DataMemory[base + i] = l.data[i];
+    cache.writebacks++;
+}
+
+// Snoop the other caches for a line. Modified copies are written back, and dropped if the line is going to be written.
+// Returns whether another cache still holds a copy.
+bool L1_Snoop(int addr, bool write)
+{
+    int index = addr / 4 % 16;
+    int tag = addr / 4 / 16;
+    bool shared = false;
+    vector<L1Cache> &L1 = System->L1;
+    for (int c = 0; c < (int)L1.size(); c++)
+    {
+        CacheLine &l = L1[c].line[index];
+        if (c == core_id)
+            continue;
+        lock_guard<mutex> lock(l.lock);
+        if (l.state == Invalid || l.tag != tag)
+            continue;
+        if (l.state == Modified)
+            L1_Writeback(*System, L1[c], index);
+        if (write)
+        {
+            l.state = Invalid;
+            L1[c].invalidations++;
+        }
+        else
+        {
+            l.state = Shared;
+            shared = true;
+        }
+    }
+    return shared;
+}
+
+// Access a line the L1 of this core already holds, without the bus: reads of a valid line and writes of an E/M line.
+// Returns false if the access needs a bus transaction.
+bool L1_Hit(int addr, bool write, int &value)
+{
+    L1Cache &cache = System->L1[core_id];
+    CacheLine &l = cache.line[addr / 4 % 16];
+    lock_guard<mutex> lock(l.lock);
+    if (l.state == Invalid || l.tag != addr / 4 / 16 || (write && l.state == Shared))
+        return false;
+    cache.hits++;
+    if (write)
+    {
+        l.state = Modified;
+        l.data[addr % 4] = value;
+    }
+    else
+        value = l.data[addr % 4];
+    return true;
+}
+
+// Get the line holding addr in the L1 of this core, filling it from data memory on a miss. Called with the bus held,
+// so no snoop can touch the line meanwhile.
+CacheLine &L1_Access(int addr, bool write)
+{
+    L1Cache &cache = System->L1[core_id];
+    int index = addr / 4 % 16;
+    int tag = addr / 4 / 16;
+    CacheLine &l = cache.line[index];
+    if (l.state != Invalid && l.tag == tag)
+    {
+        cache.hits++;
+        if (write && l.state == Shared)
+        {
+            cache.upgrades++;
+            L1_Snoop(addr, true);
+        }
+        if (write)
+            l.state = Modified;
+        return l;
+    }
+    cache.misses++;
+    if (l.state == Modified)
+        L1_Writeback(*System, cache, index);
+    bool shared = L1_Snoop(addr, write);
+    l.tag = tag;
+    for (int i = 0; i < 4; i++)
+        l.data[i] = System->DataMemory[addr / 4 * 4 + i];
+    if (write)
+        l.state = Modified;
+    else
+        l.state = shared ? Shared : Exclusive;
+    return l;
+}
+
+// Data memory read
+int Memory_read(int addr)
+{
+    if (core_id < 0)
+        return Data_memory[addr];
+    int value;
+    if (L1_Hit(addr, false, value))
+        return value;
+    lock_guard<mutex> lock(System->Bus);
+    return L1_Access(addr, false).data[addr % 4];
+}
+
+// Data memory write
+void Memory_write(int addr, int value)
+{
+    if (core_id < 0)
+    {
+        Data_memory[addr] = value;
+        return;
+    }
+    if (L1_Hit(addr, true, value))
+        return;
+    lock_guard<mutex> lock(System->Bus);
+    L1_Access(addr, true).data[addr % 4] = value;
+}
+
+// Instructions flowing out to the pipline
+void Instruction_outflow()
+{
+    Instructions_in_pipeline I = {Instruction_fetch(pc), pc, 0, Instruction_num};
+    Instruction_num++;
+    pipline.push_back(I);
+    Diagram_add(Standard_Instruction(I.ir));
+}
+
+/*
+The instruction format
+load：rt  <-  rs+offset
+op-code:100000    rs=base(5 bit)     rt(5 bit)      offset(16 bit)
+
+store: rt  ->  rs+offset
+op-code:101000    rs=base(5 bit)     rt(5 bit)      offset(16 bit)
+
+add: rd  <-  rs+rt
+op_code:000000    rs(5 bit)    rt(5 bit)   rd(5 bit)   0(5 bit)   func:100000
+
+beqz: if(rs==0)  pc=offset
+op_code:000001    rs(5 bit)    beqz:00010   offset(16 bit)
+
+
+*/
+
+// Operations of the IF stage.
+void IF()
+{
+    if (stall)
+        return;
+    if_id.ir = Instruction_fetch(pc);
+    if (if_id.ir.type == Beqz && readRegister(if_id.ir.rs) == 0)
+    {
+        pc = pc + if_id.ir.imm;
+        if_id.npc = pc;
+    }
+    else
+    {
+        pc += 4;
+        if_id.npc = pc;
+    }
+    switch (if_id.ir.type)
+    {
+    case Load:
+        for (int i = 0; i < 32; i++)
+        {
+            if (RegisterFile[i].name == if_id.ir.rs && RegisterFile[i].writing == true)
+                stall = true;
+        }
+        break;
+    case Store:
+        for (int i = 0; i < 32; i++)
+        {
+            if (RegisterFile[i].name == if_id.ir.rt && RegisterFile[i].writing == true)
+                stall = true;
+        }
+        break;
+    case Add:
+        for (int i = 0; i < 32; i++)
+        {
+            if (RegisterFile[i].name == if_id.ir.rs && RegisterFile[i].writing == true)
+                stall = true;
+            if (RegisterFile[i].name == if_id.ir.rt && RegisterFile[i].writing == true)
+                stall = true;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Operations of the ID stage.
+void ID()
+{
+    if (!Forwarding)
+    {
+        id_ex.alu_a = readRegister(if_id.ir.rs);
+        id_ex.alu_b = readRegister(if_id.ir.rt);
+        id_ex.ir = if_id.ir;
+        id_ex.imm = if_id.ir.imm;
+    }
+    else
+    {
+        switch (if_id.ir.type)
+        {
+        case Load:
+        {
+            id_ex.alu_b = readRegister(if_id.ir.rt);
+            id_ex.ir = if_id.ir;
+            id_ex.imm = if_id.ir.imm;
+            for (int i = 0; i < 32; i++)
+            {
+                if (RegisterFile[i].name == if_id.ir.rs && RegisterFile[i].writing == true)
+                    id_ex.alu_a = readRegister(if_id.ir.rs + "_else");
+                else
+                    id_ex.alu_a = readRegister(if_id.ir.rs);
+            }
+            break;
+        }
+
+        case Store:
+        {
+            id_ex.ir = if_id.ir;
+            id_ex.imm = if_id.ir.imm;
+            for (int i = 0; i < 32; i++)
+            {
+                if (RegisterFile[i].name == if_id.ir.rs && RegisterFile[i].writing == true)
+                    id_ex.alu_a = readRegister(if_id.ir.rs + "_else");
+                else
+                    id_ex.alu_a = readRegister(if_id.ir.rs);
+                if (RegisterFile[i].name == if_id.ir.rt && RegisterFile[i].writing == true)
+                    id_ex.alu_b = readRegister(if_id.ir.rt + "_else");
+                else
+                    id_ex.alu_b = readRegister(if_id.ir.rt);
+            }
+            break;
+        }
+
+        case Add:
+        {
+            id_ex.ir = if_id.ir;
+            id_ex.imm = if_id.ir.imm;
+            for (int i = 0; i < 32; i++)
+            {
+                if (RegisterFile[i].name == if_id.ir.rs)
+                {
+                    if (RegisterFile[i].writing == true)
+                        id_ex.alu_a = readRegister(if_id.ir.rs + "_else");
+                    else
+                        id_ex.alu_a = readRegister(if_id.ir.rs);
+                }
+                if (RegisterFile[i].name == if_id.ir.rt)
+                {
+                    if (RegisterFile[i].writing == true)
+                        id_ex.alu_b = readRegister(if_id.ir.rt + "_else");
+                    else
+                        id_ex.alu_b = readRegister(if_id.ir.rt);
+                }
+            }
+            break;
+        }
+
+        case Beqz:
+        {
+            id_ex.alu_b = readRegister(if_id.ir.rt);
+            id_ex.ir = if_id.ir;
+            id_ex.imm = if_id.ir.imm;
+            for (int i = 0; i < 32; i++)
+            {
+                if (RegisterFile[i].name == if_id.ir.rs && RegisterFile[i].writing == true)
+                    id_ex.alu_a = readRegister(if_id.ir.rs + "_else");
+                else
+                    id_ex.alu_a = readRegister(if_id.ir.rs);
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+    if (if_id.ir.type == Load)
+    {
+        for (int i = 0; i < 32; i++)
+        {
+            if (RegisterFile[i].name == if_id.ir.rt)
+                RegisterFile[i].writing = true;
+        }
+    }
+    if (if_id.ir.type == Add)
+    {
+        for (int i = 0; i < 32; i++)
+        {
+            if (RegisterFile[i].name == if_id.ir.rd)
+                RegisterFile[i].writing = true;
+        }
+    }
+}
+
+// Operations of the EX stage.
+void EX()
+{
+    ex_mem.ir = id_ex.ir;
+    if (id_ex.ir.type == Add)
+    {
+        ex_mem.alu_o = id_ex.alu_a + id_ex.alu_b;
+        if (Forwarding)
+        {
+            Register Reg;
+            Reg.name = ex_mem.ir.rd + "_else";
+            Reg.value = ex_mem.alu_o;
+            RegisterFile_else.push_back(Reg);
+            stall = false;
+        }
+    }
+    else if (id_ex.ir.type == Load || id_ex.ir.type == Store)
+    {
+        ex_mem.alu_o = id_ex.alu_a + id_ex.imm;
+        ex_mem.alu_b = id_ex.alu_b;
+    }
+}
+
+// Operations of the MEM stage.
+void MEM()
+{
+    mem_wb.ir = ex_mem.ir;
+    if (ex_mem.ir.type == Add)
+    {
+        mem_wb.alu_o = ex_mem.alu_o;
+    }
+    else if (ex_mem.ir.type == Load)
+    {
+        mem_wb.lmd = Memory_read(ex_mem.alu_o);
+        if (Forwarding)
+        {
+            Register Reg;
+            Reg.name = mem_wb.ir.rt + "_else";
+            Reg.value = mem_wb.lmd;
+            RegisterFile_else.push_back(Reg);
+            stall = false;
+        }
+    }
+    else if (ex_mem.ir.type == Store)
+    {
+        Memory_write(ex_mem.alu_o, ex_mem.alu_b);
+    }
+}
+
+// Operations of the WB stage.
+void WB()
+{
+    if (mem_wb.ir.type == Add)
+    {
+        writeRegister(mem_wb.ir.rd, mem_wb.alu_o);
+        for (int i = 0; i < 32; i++)
+        {
+            if (RegisterFile[i].name == mem_wb.ir.rd && RegisterFile[i].writing == true)
+                RegisterFile[i].writing = false;
+        }
+    }
+    else if (mem_wb.ir.type == Load)
+    {
+        writeRegister(mem_wb.ir.rt, mem_wb.lmd);
+        for (int i = 0; i < 32; i++)
+        {
+            if (RegisterFile[i].name == mem_wb.ir.rt && RegisterFile[i].writing == true)
+                RegisterFile[i].writing = false;
+        }
+    }
+    if (!Forwarding)
+        stall = false;
+}
+
+// Unmap the program image
+void Image_unload()
+{
+    if (Image_map)
+        munmap(Image_map, Image_size);
+    Image_map = nullptr;
+    Image_size = 0;
+    Image_text = nullptr;
+    Image_words = 0;
+    Image_decoded.clear();
+    Image_data = nullptr;
+    Image_data_words = 0;
+}
+
+// Place the data section of the mapped image at address 0 of the data memory, which multicore runs share
+void Image_data_load()
+{
+    unique_lock<mutex> lock;
+    if (System)
+        lock = unique_lock<mutex>(System->Bus);
+    for (int i = 0; i < Image_data_words && i < 1000; i++)
+        Data_memory[i] = Image_data[i];
+}
+
+// Map a packed binary program image. Returns false if the file is not an image.
+// The mapping is private and read-only, so instances loading the same image share its pages.
+bool Image_load(string path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(ImageHeader))
+    {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    const ImageHeader *header = (const ImageHeader *)map;
+    size_t words = (size_t)header->text_words + header->data_words;
+    if (memcmp(header->magic, "MIPS", 4) != 0 || sizeof(ImageHeader) + words * 4 > (size_t)st.st_size)
+    {
+        munmap(map, st.st_size);
+        return false;
+    }
+    Image_map = map;
+    Image_size = st.st_size;
+    Image_text = (const uint32_t *)(header + 1);
+    Image_words = header->text_words;
+    Image_data = Image_text + header->text_words;
+    Image_data_words = header->data_words;
+    Image_data_load();
+    return true;
+}
+
+// Load a program into instruction memory
+bool Program_load(string path)
+{
+    Image_unload();
+    Skipped_lines = 0;
+    if (Image_load(path))
+        return true;
+    ifstream infile;
+    infile.open(path, ios::in);
+    if (!infile.is_open())
+        return false;
+    string buf;
+    while (getline(infile, buf))
+        Instruction_read(buf);
+    return true;
+}
+
+// Execute one clockcycle
+void Single_step_execution()
+{
+    if (Instruction_count() == 0 || has_end)
+        return;
+    bool has_add = false;
+    bool true_stall = false;
+    if (pipline.empty() && pc / 4 < Instruction_count())
+    {
+        Instruction_outflow();
+        has_add = true;
+    }
+    ClockCycles++;
+    for (auto i = pipline.begin(); i != pipline.end();)
+    {
+        switch (i->stage)
+        {
+        case If:
+        {
+            IF();
+            Diagram_record(i->order, ClockCycles, i->stage);
+            i->stage++;
+            i++;
+            break;
+        }
+
+        case Id:
+        {
+            if (!stall)
+            {
+                ID();
+                Diagram_record(i->order, ClockCycles, i->stage);
+                i->stage++;
+            }
+            else
+            {
+                Diagram_record(i->order, ClockCycles, StallCell);
+                true_stall = true;
+            }
+
+            if (!has_add && !stall && pc / 4 < Instruction_count())
+            {
+                Instruction_outflow();
+                has_add = true;
+            }
+            i++;
+            break;
+        }
+
+        case Ex:
+        {
+            EX();
+            Diagram_record(i->order, ClockCycles, i->stage);
+            i->stage++;
+            if (!has_add && !stall && pc / 4 < Instruction_count())
+            {
+                Instruction_outflow();
+                has_add = true;
+            }
+            i++;
+            break;
+        }
+
+        case Mem:
+        {
+            MEM();
+            Diagram_record(i->order, ClockCycles, i->stage);
+            i->stage++;
+            if (!has_add && !stall && pc / 4 < Instruction_count())
+            {
+                Instruction_outflow();
+                has_add = true;
+            }
+            i++;
+            break;
+        }
+
+        case Wb:
+        {
+            WB();
+            Diagram_record(i->order, ClockCycles, i->stage);
+            i->stage++;
+            auto j = ++i;
+            pipline.erase(--i);
+            i = j;
+            if (!has_add && !stall && pc / 4 < Instruction_count())
+            {
+                Instruction_outflow();
+                has_add = true;
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+    if (true_stall)
+        StallCycles++;
+    if (pipline.empty())
+        has_end = true;
+}
+
+// Run a program on one core of the multicore simulation
+void Core_run(int id, string path, bool forwarding, MemorySystem &system, Barrier &barrier, CoreResult &result)
+{
+    System = &system;
+    Data_memory = system.DataMemory;
+    core_id = id;
+    Forwarding = forwarding;
+    Core_Init();
+    bool loaded = Program_load(path) && Instruction_count() != 0;
+    barrier.wait(true);
+    do
+    {
+        for (int i = 0; loaded && i < Quantum && !has_end; i++)
+            Single_step_execution();
+    } while (!barrier.wait(!loaded || has_end || ClockCycles >= Max_core_cycles));
+    result = {path, loaded, has_end, RegisterFile, ClockCycles, StallCycles};
+    Image_unload();
+}
+
+
+} // namespace
+
+// Define the state of a core kept by a Simulator while it is not running.
+struct CoreState
+{
+    IF_ID if_id{};
+    ID_EX id_ex{};
+    EX_MEM ex_mem{};
+    MEM_WB mem_wb{};
+    vector<Register> RegisterFile = vector<Register>(32, {"", 0});
+    vector<Instruction> InstructionMemory;
+    vector<Register> RegisterFile_else;
+    list<Instructions_in_pipeline> pipline;
+    const uint32_t *Image_text = nullptr;
+    int Image_words = 0;
+    void *Image_map = nullptr;
+    size_t Image_size = 0;
+    unordered_map<int, Instruction> Image_decoded;
+    const uint32_t *Image_data = nullptr;
+    int Image_data_words = 0;
+    int Skipped_lines = 0;
+    int pc = 0;
+    int Instruction_num = 1;
+    int ClockCycles = 0;
+    int StallCycles = 0;
+    bool has_end = false;
+    bool stall = false;
+    vector<DiagramRow> *ClockCycles_Diagram = nullptr;
+    int core_id = -1;
+    bool Forwarding = false;
+    int *Data_memory = nullptr;
+
+    // Owned by the simulator, the swapped state only points to them
+    vector<DiagramRow> diagram;
+    int memory[Simulator::MemoryWords] = {0};
+};
+
+namespace
+{
+
+thread_local Simulator *Active = nullptr; // Simulator whose state is swapped in on this thread
+
+// Exchange the state of the core on this thread with a saved one
+void Core_swap(CoreState &s)
+{
+    swap(if_id, s.if_id);
+    swap(id_ex, s.id_ex);
+    swap(ex_mem, s.ex_mem);
+    swap(mem_wb, s.mem_wb);
+    swap(RegisterFile, s.RegisterFile);
+    swap(InstructionMemory, s.InstructionMemory);
+    swap(RegisterFile_else, s.RegisterFile_else);
+    swap(pipline, s.pipline);
+    swap(Image_text, s.Image_text);
+    swap(Image_words, s.Image_words);
+    swap(Image_map, s.Image_map);
+    swap(Image_size, s.Image_size);
+    swap(Image_decoded, s.Image_decoded);
+    swap(Image_data, s.Image_data);
+    swap(Image_data_words, s.Image_data_words);
+    swap(Skipped_lines, s.Skipped_lines);
+    swap(pc, s.pc);
+    swap(Instruction_num, s.Instruction_num);
+    swap(ClockCycles, s.ClockCycles);
+    swap(StallCycles, s.StallCycles);
+    swap(has_end, s.has_end);
+    swap(stall, s.stall);
+    swap(ClockCycles_Diagram, s.ClockCycles_Diagram);
+    swap(core_id, s.core_id);
+    swap(Forwarding, s.Forwarding);
+    swap(Data_memory, s.Data_memory);
+}
+
+} // namespace
+
+// Swaps the state of a simulator in for the lifetime of the guard, and the previously active one back afterwards
+struct Simulator::Activate
+{
+    Simulator *sim;
+    Simulator *prev;
+
+    Activate(const Simulator *s) : sim(const_cast<Simulator *>(s)), prev(Active)
+    {
+        if (prev == sim)
+            return;
+        if (prev)
+            Core_swap(*prev->state);
+        Core_swap(*sim->state);
+        Active = sim;
+    }
+
+    ~Activate()
+    {
+        if (prev == sim)
+            return;
+        Core_swap(*sim->state);
+        if (prev)
+            Core_swap(*prev->state);
+        Active = prev;
+    }
+};
+
+Simulator::Simulator(bool forwarding, bool record_diagram) : state(new CoreState)
+{
+    state->Forwarding = forwarding;
+    state->Data_memory = state->memory;
+    if (record_diagram)
+        state->ClockCycles_Diagram = &state->diagram;
+    Activate a(this);
+    Core_Init();
+}
+
+// The state is released without swapping it in: a static Simulator is destroyed after the thread_local state of the
+// main thread, which must not be touched then.
+Simulator::~Simulator()
+{
+    if (state->Image_map)
+        munmap(state->Image_map, state->Image_size);
+    delete state;
+}
+
+void Simulator::load(const uint32_t *words, size_t count)
+{
+    Activate a(this);
+    Image_unload();
+    reset();
+    InstructionMemory.clear();
+    Skipped_lines = 0;
+    for (size_t i = 0; i < count; i++)
+        InstructionMemory.push_back(Instruction_decode(words[i]));
+}
+
+bool Simulator::load(const string &path)
+{
+    Activate a(this);
+    Image_unload();
+    reset();
+    InstructionMemory.clear();
+    return Program_load(path);
+}
+
+void Simulator::reset()
+{
+    Activate a(this);
+    Core_Init();
+    state->diagram.clear();
+    memset(state->memory, 0, sizeof(state->memory));
+    Image_data_load();
+}
+
+void Simulator::set_register(int reg, int value)
+{
+    if (reg < 0 || reg > 31)
+        throw out_of_range("Simulator::set_register: no register r" + to_string(reg));
+    Activate a(this);
+    RegisterFile[reg].value = value;
+}
+
+void Simulator::set_memory(int addr, int value)
+{
+    if (addr < 0 || addr >= MemoryWords)
+        throw out_of_range("Simulator::set_memory: address " + to_string(addr) + " outside the data memory");
+    state->memory[addr] = value;
+}
+
+void Simulator::set_forwarding(bool forwarding)
+{
+    Activate a(this);
+    Forwarding = forwarding;
+    reset();
+}
+
+bool Simulator::forwarding() const
+{
+    return Active == this ? Forwarding : state->Forwarding;
+}
+
+long Simulator::step(long n)
+{
+    Activate a(this);
+    long i = 0;
+    for (; i < n && Instruction_count() != 0 && !has_end; i++)
+        Single_step_execution();
+    return i;
+}
+
+long Simulator::run()
+{
+    Activate a(this);
+    long i = 0;
+    for (; Instruction_count() != 0 && !has_end; i++)
+        Single_step_execution();
+    return i;
+}
+
+long Simulator::run_until(const function<bool(const Simulator &)> &predicate)
+{
+    Activate a(this);
+    long i = 0;
+    for (; Instruction_count() != 0 && !has_end && !predicate(*this); i++)
+        Single_step_execution();
+    return i;
+}
+
+bool Simulator::loaded() const
+{
+    return program_size() != 0;
+}
+
+int Simulator::skipped_lines() const
+{
+    return Active == this ? Skipped_lines : state->Skipped_lines;
+}
+
+bool Simulator::finished() const
+{
+    return Active == this ? has_end : state->has_end;
+}
+
+int Simulator::program_size() const
+{
+    if (Active == this)
+        return Instruction_count();
+    return state->Image_text ? state->Image_words : state->InstructionMemory.size();
+}
+
+Instruction Simulator::instruction(int pc) const
+{
+    Activate a(this);
+    if (pc < 0 || pc % 4 != 0 || pc / 4 >= Instruction_count())
+        throw out_of_range("Simulator::instruction: no instruction at " + to_string(pc));
+    return Instruction_fetch(pc);
+}
+
+vector<Register> Simulator::registers() const
+{
+    return Active == this ? RegisterFile : state->RegisterFile;
+}
+
+const int *Simulator::memory() const
+{
+    return state->memory;
+}
+
+vector<int> Simulator::initial_memory() const
+{
+    vector<int> memory(MemoryWords, 0);
+    const uint32_t *data = Active == this ? Image_data : state->Image_data;
+    int words = Active == this ? Image_data_words : state->Image_data_words;
+    for (int i = 0; i < words && i < MemoryWords; i++)
+        memory[i] = data[i];
+    return memory;
+}
+
+Statistics Simulator::stats() const
+{
+    if (Active == this)
+        return {ClockCycles, StallCycles, Instruction_num - 1};
+    return {state->ClockCycles, state->StallCycles, state->Instruction_num - 1};
+}
+
+list<Instructions_in_pipeline> Simulator::pipeline() const
+{
+    return Active == this ? pipline : state->pipline;
+}
+
+const vector<DiagramRow> &Simulator::diagram() const
+{
+    return state->diagram;
+}
+
+vector<CoreResult> Multicore_execute(const vector<string> &paths, bool forwarding, vector<int> *memory)
+{
+    int n = paths.size();
+    MemorySystem system(n);
+    vector<L1Cache> &L1 = system.L1;
+    vector<CoreResult> result(n);
+    vector<thread> cores;
+    Barrier barrier(n);
+    for (int i = 0; i < n; i++)
+        cores.emplace_back(Core_run, i, paths[i], forwarding, ref(system), ref(barrier), ref(result[i]));
+    for (int i = 0; i < n; i++)
+        cores[i].join();
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < 16; j++)
+            if (L1[i].line[j].state == Modified)
+                L1_Writeback(system, L1[i], j);
+        result[i].hits = L1[i].hits;
+        result[i].misses = L1[i].misses;
+        result[i].upgrades = L1[i].upgrades;
+        result[i].invalidations = L1[i].invalidations;
+        result[i].writebacks = L1[i].writebacks;
+    }
+    if (memory)
+        memory->assign(system.DataMemory, system.DataMemory + 1000);
+    return result;
+}
+
+} // namespace mips
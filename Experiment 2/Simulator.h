@@ -0,0 +1,178 @@
+/*
+    Library interface of the five segment MIPS pipeline simulator.
+    The core does no I/O. make builds it with BatchSimulator.cpp into libsimulator.a; link that with -pthread into
+    the tool that embeds the simulator. MIPS.cpp is the command line client. Everything is declared in namespace mips.
+*/
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+namespace mips
+{
+
+// Define instruction types.
+enum InstructionType
+{
+    Load = 1,
+    Store,
+    Add,
+    Beqz,
+    Nop
+};
+
+// Define pipline stages.
+enum PiplineStage
+{
+    If = 0,
+    Id,
+    Ex,
+    Mem,
+    Wb
+};
+
+// Define instructions in instruction memory.
+struct Instruction
+{
+    InstructionType type;
+    std::string rs = "r0";
+    std::string rt = "r0";
+    std::string rd = "r0";
+    int imm = -1;
+};
+
+// Define instructions in pipline.
+struct Instructions_in_pipeline
+{
+    Instruction ir;
+    int pc = 0;
+    int stage = 0;
+    int order = 0;
+};
+
+// Define registers.
+struct Register
+{
+    std::string name;
+    int value;
+    bool writing = false;
+};
+
+// Define a row of the clockcycles diagram.
+// Cells are stage indices (PiplineStage), StallCell or BlankCell.
+struct DiagramRow
+{
+    std::string instruction;
+    int first_cycle = 0;     // Clockcycle of the first cell
+    std::vector<char> cells; // Cell of each clockcycle from first_cycle on
+};
+
+const int StallCell = 5;
+const int BlankCell = 6;
+
+// Define the statistics of a program run.
+struct Statistics
+{
+    int ClockCycles = 0;  // Number of clockcycles that have already occurred
+    int StallCycles = 0;  // Number of clockcycles paused on the pipline
+    int Instructions = 0; // Number of instructions that have already flowed out
+};
+
+// Define the result of a core after multicore execution.
+struct CoreResult
+{
+    std::string file_path;
+    bool loaded = false;
+    bool finished = false; // Whether the program ended; a core is stopped after 1000000 clockcycles
+    std::vector<Register> RegisterFile;
+    int ClockCycles = 0;
+    int StallCycles = 0;
+    int hits = 0; // Private L1 statistics
+    int misses = 0;
+    int upgrades = 0; // Writes to shared lines; misses and upgrades are the bus transactions
+    int invalidations = 0;
+    int writebacks = 0;
+};
+
+struct CoreState;
+
+// A single pipeline with its own registers, instruction memory and MemoryWords words of data memory.
+// Register numbers, memory addresses (in words) and instruction addresses (in bytes) are checked by the members
+// that take them, which throw std::out_of_range.
+// Any number of simulators may exist; each must be used by one thread at a time.
+// The pipeline stages are the functions of the single core simulator and work on thread_local state, which is what
+// lets the cores of Multicore_execute run on their own threads. A Simulator keeps that state while idle and swaps it
+// in for each call that executes or changes the core. The swap exchanges a fixed set of scalars and container handles,
+// never copying registers, program or diagram, so step(n) and run() pay for it once rather than per clockcycle.
+// The read-only accessors (registers, stats, pipeline, finished, ...) read the state without swapping: the saved state,
+// or the thread_local one while the simulator is running (inside run_until's predicate).
+class Simulator
+{
+public:
+    static const int MemoryWords = 1000;
+
+    Simulator(bool forwarding = false, bool record_diagram = false);
+    ~Simulator();
+    Simulator(const Simulator &) = delete;
+    Simulator &operator=(const Simulator &) = delete;
+
+    // Load a program and reset the simulator. A file may hold one binary instruction per line or be a packed image.
+    void load(const uint32_t *words, size_t count);
+    void load(const std::vector<uint32_t> &words) { load(words.data(), words.size()); }
+    bool load(const std::string &path);
+
+    // Reset registers, data memory, pipeline, statistics and diagram, keeping the program.
+    // Registers start as r1 = 1, r2 = 2 and 0 otherwise, and data memory holds the data section of a loaded image from address 0.
+    // set_register/set_memory change the initial state after a reset.
+    void reset();
+    void set_register(int reg, int value);
+    void set_memory(int addr, int value);
+    void set_forwarding(bool forwarding);
+    bool forwarding() const;
+
+    // Execute up to n clockcycles, stopping when the program ends. Returns the number executed.
+    long step(long n = 1);
+    // Execute to the end of the program.
+    long run();
+    // Execute until predicate holds (checked before every clockcycle) or the program ends.
+    long run_until(const std::function<bool(const Simulator &)> &predicate);
+
+    bool loaded() const;
+    // Number of lines of the last program file that were neither blank nor an instruction and were skipped
+    int skipped_lines() const;
+    bool finished() const;
+    int program_size() const;
+    // Instruction at byte address pc, a multiple of 4 below 4 * program_size()
+    Instruction instruction(int pc) const;
+    std::vector<Register> registers() const;
+    // The MemoryWords words of data memory
+    const int *memory() const;
+    // Data memory as a reset leaves it: the data section of a loaded image, zero elsewhere.
+    std::vector<int> initial_memory() const;
+    Statistics stats() const;
+    std::list<Instructions_in_pipeline> pipeline() const;
+    const std::vector<DiagramRow> &diagram() const;
+
+private:
+    struct Activate;
+    CoreState *state;
+};
+
+// Decode a binary instruction word. Unknown words are treated as nop.
+Instruction Instruction_decode(uint32_t word);
+
+// Run one program per core on shared data memory, each core on its own thread.
+// Every call has its own data memory and caches, so calls from different threads may run concurrently.
+// If memory is given, it receives the final data memory (1000 words) after the caches are written back.
+std::vector<CoreResult> Multicore_execute(const std::vector<std::string> &paths, bool forwarding, std::vector<int> *memory = nullptr);
+
+} // namespace mips
+
+#endif